@@ -38,42 +38,497 @@ SOFTWARE.
 #include <cstdint>
 #include <cassert>
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <cstring>
 #include <vector>
+#include <ostream>
+#include <chrono>
+#include <new>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
 
 namespace Lomont::Languages {
 
+	// whole pages straight from the OS where possible, so freeing them returns them to the OS
+	constexpr uint32_t PageBytes = 4096;
+
+	inline void* PageAlloc(size_t bytes)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return p == MAP_FAILED ? nullptr : p;
+#else
+		return ::operator new(bytes, std::align_val_t{ PageBytes }, std::nothrow);
+#endif
+	}
+
+	inline void PageFree(void* p, [[maybe_unused]] size_t bytes)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		munmap(p, bytes);
+#else
+		::operator delete(p, std::align_val_t{ PageBytes });
+#endif
+	}
+
+	/* Lock free list any thread can push to, which one thread takes whole. Entries are
+	 * named by a link, nonzero, and hold the link of the next entry in storage of the
+	 * caller's, such as the freed block itself, so the list needs no memory. 0 is the empty list.
+	 */
+	template<typename Link, typename SetNext>
+	void PushLockFree(std::atomic<Link>& head, Link link, SetNext&& setNext)
+	{
+		Link next = head.load(std::memory_order_relaxed);
+		do
+		{
+			setNext(next);
+		} while (!head.compare_exchange_weak(next, link, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// take the whole list, then release each entry, reading its next link first, so release
+	// may let the entry be pushed again. Returns the number of entries
+	template<typename Link, typename GetNext, typename Release>
+	uint32_t DrainLockFree(std::atomic<Link>& head, GetNext&& getNext, Release&& release)
+	{
+		Link link = head.exchange(0, std::memory_order_acquire);
+		uint32_t count = 0;
+		while (link != 0)
+		{
+			const auto entry = link;
+			link = getNext(entry);
+			release(entry);
+			++count;
+		}
+		return count;
+	}
+
+	/* Pool memory from PageAlloc, left uninitialized. Untouched mmap pages cost nothing
+	 * until written, so setting up a heap only faults in the pages holding the root chunk's
+	 * header and footer, however large the pool.
+	 */
+	class PagePool
+	{
+	public:
+		PagePool() = default;
+		PagePool(const PagePool&) = delete;
+		PagePool& operator=(const PagePool&) = delete;
+		~PagePool()
+		{
+			if (bytes != nullptr)
+				PageFree(bytes, mapped);
+		}
+
+		// get the memory, once
+		void Allocate(size_t size)
+		{
+			if (size == 0)
+				return;
+			mapped = (size + PageBytes - 1) / PageBytes * PageBytes;
+			bytes = static_cast<uint8_t*>(PageAlloc(mapped));
+			if (bytes == nullptr)
+				throw std::bad_alloc();
+			count = size;
+		}
+
+		[[nodiscard]] uint8_t* data() { return bytes; }
+		[[nodiscard]] const uint8_t* data() const { return bytes; }
+		[[nodiscard]] size_t size() const { return count; }
+
+	private:
+		uint8_t* bytes{ nullptr };
+		size_t count{ 0 }, mapped{ 0 };
+	};
+
+	// where an allocation goes, hot blocks are kept together for cache and TLB locality
+	enum class Placement : uint8_t
+	{
+		Cold, // top of the free chunk found, the default
+		Hot   // bottom of the lowest of a few fitting free chunks, and gathered at the bottom of the heap by GarbageCollector::Compact
+	};
+
+	// order of chunks in each free bin, which decides which fitting chunk is reused
+	enum class FreeList
+	{
+		AfterHead,     // each freed chunk goes second, behind the head, the original order
+		Lifo,          // most recently freed first, reuses cache warm memory
+		AddressOrdered // lowest address first, packs the bottom of the heap and fragments less, frees cost O(bin length)
+	};
+
+	// amount of validation compiled into the allocator
+	enum class Checks
+	{
+		None,    // no validation at all, not even asserts
+		Light,   // asserts, and freeing a Ref that is not live throws, the default
+		Paranoid // guard bytes on every block, checked along with the block header on each free
+	};
+
+	// whether allocator statistics are tracked
+	enum class Stats { Off, On };
+
+	// instrumentation points reported to a tracer
+	enum class TraceEvent
+	{
+		Compact,           // all of Compact, and each of its phases:
+		CompactMarkRefs,   // 1. store ref index in each used block, or with Policy::blockOwners, count hot blocks
+		CompactUnlinkFree, // 2. unlink free chunks from bins
+		CompactSlide,      // 3. slide used chunks down, bytes = bytes moved
+		CompactFreeChunk,  // 4. build the final free chunk, bytes = its size
+		CompactFixRefs,    // 5. update refs to the moved blocks
+		AllocFail,         // AllocPtr found no free chunk, bytes = requested size
+		Merge,             // two free chunks merged, bytes = merged size
+		LargeAlloc         // AllocPtr of at least Tracer::largeAllocBytes, bytes = requested size
+	};
+
+	/* Tracer that does nothing, and compiles away completely.
+	 * To trace, set Policy::Tracer to a type with the same members and enabled = true.
+	 * The allocator holds one tracer instance, as member tracer.
+	 */
+	struct NullTracer
+	{
+		static constexpr bool enabled = false;
+		static constexpr uint32_t largeAllocBytes = 4096;
+		void Begin(TraceEvent) {}
+		void End(TraceEvent, uint64_t /*bytes*/) {}
+		void Instant(TraceEvent, uint64_t /*bytes*/) {}
+	};
+
+	/* Tracer recording timestamped events in memory, written out in the
+	 * Chrome trace event JSON format, which chrome://tracing and Perfetto load.
+	 */
+	class ChromeTracer
+	{
+	public:
+		static constexpr bool enabled = true;
+		static constexpr uint32_t largeAllocBytes = 4096;
+
+		void Begin(TraceEvent event) { Record(event, 'B', 0); }
+		void End(TraceEvent event, uint64_t bytes) { Record(event, 'E', bytes); }
+		void Instant(TraceEvent event, uint64_t bytes) { Record(event, 'i', bytes); }
+
+		// write all events recorded so far as a JSON trace, tid labels this heap in the trace
+		void Write(std::ostream& os, uint32_t tid = 1) const
+		{
+			os << "{\"traceEvents\":[";
+			for (auto i = 0u; i < events.size(); ++i)
+			{
+				const auto& e = events[i];
+				os << (i == 0 ? "\n" : ",\n")
+					<< "{\"name\":\"" << Name(e.event) << "\",\"cat\":\"gc\",\"ph\":\"" << e.phase
+					<< "\",\"ts\":" << e.micros << ",\"pid\":1,\"tid\":" << tid;
+				if (e.phase == 'i')
+					os << ",\"s\":\"t\"";
+				if (e.phase != 'B')
+					os << ",\"args\":{\"bytes\":" << e.bytes << "}";
+				os << "}";
+			}
+			os << "\n]}\n";
+		}
+
+		void Clear() { events.clear(); }
+
+	private:
+		struct Event
+		{
+			TraceEvent event;
+			char phase; // B,E,i as in trace format
+			uint64_t micros;
+			uint64_t bytes;
+		};
+		std::vector<Event> events;
+		std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+
+		void Record(TraceEvent event, char phase, uint64_t bytes)
+		{
+			const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			events.push_back({ event, phase, static_cast<uint64_t>(micros), bytes });
+		}
+
+		static const char* Name(TraceEvent event)
+		{
+			switch (event)
+			{
+			case TraceEvent::Compact: return "Compact";
+			case TraceEvent::CompactMarkRefs: return "1 mark refs";
+			case TraceEvent::CompactUnlinkFree: return "2 unlink free";
+			case TraceEvent::CompactSlide: return "3 slide";
+			case TraceEvent::CompactFreeChunk: return "4 free chunk";
+			case TraceEvent::CompactFixRefs: return "5 fix refs";
+			case TraceEvent::AllocFail: return "AllocFail";
+			case TraceEvent::Merge: return "Merge";
+			case TraceEvent::LargeAlloc: return "LargeAlloc";
+			}
+			return "unknown";
+		}
+	};
+
+	/* Vector stored in fixed size pages reached through a small directory, the default ref
+	 * table. Growing adds a page, so entries never move, and push_back never copies the table.
+	 * A full directory is replaced by one twice the size, and the old one is kept until
+	 * shrink_to_fit, so another thread still indexing through it reads the same entries.
+	 * The kept directories total less than the current one. No page is allocated until the
+	 * first push_back or reserve.
+	 * Costs one more load per access than std::vector. With a single writer, operator[] loads
+	 * the directory relaxed; other threads use shared(), which acquires it.
+	 */
+	template<typename T, uint32_t PageEntries>
+	class PagedVector
+	{
+		static_assert(PageEntries != 0 && (PageEntries & (PageEntries - 1)) == 0, "PageEntries must be a power of 2");
+
+		template<typename Owner, typename Item>
+		class Iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = T;
+			using difference_type = std::ptrdiff_t;
+			using pointer = Item*;
+			using reference = Item&;
+
+			Iterator() = default;
+			Iterator(Owner* owner, size_t index) : owner(owner), index(index) {}
+			reference operator*() const { return (*owner)[index]; }
+			pointer operator->() const { return &(*owner)[index]; }
+			Iterator& operator++() { ++index; return *this; }
+			Iterator operator++(int) { auto old = *this; ++index; return old; }
+			bool operator==(const Iterator& other) const { return index == other.index; }
+
+		private:
+			Owner* owner{ nullptr };
+			size_t index{ 0 };
+		};
+
+	public:
+		// growing never moves or frees memory another thread may be reading, see GarbageCollector::ReadRef
+		static constexpr bool stableGrowth = true;
+
+		[[nodiscard]] size_t size() const { return count; }
+		[[nodiscard]] size_t capacity() const { return pages.size() * PageEntries; }
+		[[nodiscard]] static constexpr size_t max_size() { return static_cast<uint32_t>(-1); }
+		void reserve(size_t newCapacity)
+		{
+			while (capacity() < newCapacity)
+				AddPage();
+		}
+		void resize(size_t newSize)
+		{
+			reserve(newSize);
+			for (auto i = count; i < newSize; ++i)
+				(*this)[i] = T{};
+			count = static_cast<uint32_t>(newSize);
+		}
+		void push_back(const T& item)
+		{
+			if (count == capacity())
+				AddPage();
+			(*this)[count++] = item;
+		}
+		void clear() { count = 0; }
+		// releases pages past size() and old directories, so no other thread may be reading
+		void shrink_to_fit()
+		{
+			pages.resize((count + PageEntries - 1) / PageEntries);
+			pages.shrink_to_fit();
+			directories.clear();
+			directoryCapacity = 0;
+			directory.store(nullptr, std::memory_order_relaxed);
+			if (!pages.empty())
+				NewDirectory(static_cast<uint32_t>(pages.size()));
+		}
+
+		T& operator[](size_t index) { return directory.load(std::memory_order_relaxed)[index / PageEntries][index % PageEntries]; }
+		const T& operator[](size_t index) const { return directory.load(std::memory_order_relaxed)[index / PageEntries][index % PageEntries]; }
+		// for threads other than the writer, sees the pages of a directory published since they last looked
+		const T& shared(size_t index) const { return directory.load(std::memory_order_acquire)[index / PageEntries][index % PageEntries]; }
+		auto begin() { return Iterator<PagedVector, T>(this, 0); }
+		auto end() { return Iterator<PagedVector, T>(this, count); }
+		auto begin() const { return Iterator<const PagedVector, const T>(this, 0); }
+		auto end() const { return Iterator<const PagedVector, const T>(this, count); }
+
+	private:
+		std::vector<std::unique_ptr<T[]>> pages; // owns the pages, the owning thread only
+		std::vector<std::unique_ptr<T*[]>> directories; // current directory last, earlier ones kept for readers
+		std::atomic<T**> directory{ nullptr }; // page pointers, what operator[] reads
+		uint32_t directoryCapacity{ 0 };
+		uint32_t count{ 0 };
+
+		void AddPage()
+		{
+			if (pages.size() == directoryCapacity)
+				NewDirectory(std::max(4u, 2 * directoryCapacity));
+			pages.push_back(std::make_unique<T[]>(PageEntries));
+			directory.load(std::memory_order_relaxed)[pages.size() - 1] = pages.back().get();
+		}
+
+		// publish a directory with room for capacity pages, keeping the old one
+		void NewDirectory(uint32_t capacity)
+		{
+			auto grown = std::make_unique<T*[]>(capacity);
+			for (auto i = 0u; i < pages.size(); ++i)
+				grown[i] = pages[i].get();
+			directory.store(grown.get(), std::memory_order_release);
+			directories.push_back(std::move(grown));
+			directoryCapacity = capacity;
+		}
+	};
+
+	/* Fixed capacity vector, for allocation free tables, see StaticPolicy.
+	 * Zero initialized, so a static instance needs no startup code.
+	 */
+	template<typename T, uint32_t N>
+	class FixedVector
+	{
+	public:
+		constexpr FixedVector() = default;
+
+		// never grows, so entries never move
+		static constexpr bool stableGrowth = true;
+
+		[[nodiscard]] size_t size() const { return count; }
+		[[nodiscard]] static constexpr size_t capacity() { return N; }
+		[[nodiscard]] static constexpr size_t max_size() { return N; }
+		void reserve(size_t) {} // storage is fixed
+		void clear() { count = 0; }
+		void shrink_to_fit() {} // storage is fixed
+		void resize(size_t newSize)
+		{
+			if (newSize > N)
+				throw std::length_error("FixedVector full");
+			for (auto i = count; i < newSize; ++i)
+				items[i] = T{};
+			count = static_cast<uint32_t>(newSize);
+		}
+		void push_back(const T& item)
+		{
+			if (count == N)
+				throw std::length_error("FixedVector full");
+			items[count++] = item;
+		}
+
+		T& operator[](size_t index) { return items[index]; }
+		const T& operator[](size_t index) const { return items[index]; }
+		const T& shared(size_t index) const { return items[index]; } // storage never moves
+		T* begin() { return items.data(); }
+		T* end() { return items.data() + count; }
+		const T* begin() const { return items.data(); }
+		const T* end() const { return items.data() + count; }
+
+	private:
+		std::array<T, N> items{};
+		uint32_t count{ 0 };
+	};
+
+	/* Compile time options for the Allocator and GarbageCollector.
+	 * Use as is, or derive from it to override options.
+	 */
+	template<Checks checkLevel = Checks::Light, Stats statLevel = Stats::On>
+	struct AllocatorPolicy
+	{
+		static constexpr Checks checks = checkLevel;
+		static constexpr Stats stats = statLevel;
+		using Tracer = NullTracer; // see NullTracer
+		using Size = uint32_t; // block sizes and pool offsets, uint16_t for pools under 64K, see SmallPolicy
+		using Ref = uint32_t;  // GarbageCollector handles, limits the number of live refs
+		// allow 8 byte chunks, with 16 bit free list links, for pools up to 256K, see BasicAllocator::TinySize
+		static constexpr bool tinyChunks = false;
+		// nonzero to hold a pool of this many bytes inside the object instead of on the heap, see StaticPolicy
+		static constexpr uint32_t poolBytes = 0;
+		// GarbageCollector ref table, std::vector also works, with faster lookups but copying growth and no lock free reads, see ReadRef
+		template<typename T> using RefTable = PagedVector<T, 1024>;
+		static constexpr FreeList freeList = FreeList::AfterHead;
+		// nonzero, a power of 2, to count PointerFromRef calls per ref, reported as heat of calls / heatScale, see GarbageCollector::Heat
+		static constexpr uint32_t heatScale = 0;
+		// heat at which Compact treats a block as hot, see GarbageCollector::Heat
+		static constexpr uint32_t hotHeat = 4;
+		// nonzero to park freed chunks up to this many bytes on exact size quick lists, merged later, see BasicAllocator::FlushQuickLists
+		static constexpr uint32_t quickListBytes = 0;
+		// nonzero to give each ref a 16 bit type id, with a registry of this many types, see GarbageCollector::RegisterType
+		static constexpr uint32_t maxTypes = 0;
+		// nonzero to sample about one AllocRef per this many bytes allocated, by allocation site, see GarbageCollector::SetAllocSite
+		static constexpr uint32_t profileSampleBytes = 0;
+		// end each GarbageCollector block with its Ref, sizeof(Ref) more per block, so CompactStep and ForEachChunk
+		// find a block's ref without walking the ref table, see GarbageCollector::OwnerOf
+		static constexpr bool blockOwners = false;
+	};
+
+	/* Policy for pools under 64K on small microcontrollers: 16 bit chunk headers,
+	 * free list links, and Refs, so each block carries 2 bytes of overhead instead of 4,
+	 * free blocks can be 8 bytes, and ref table entries shrink where pointers are 32 bits.
+	 */
+	template<Checks checkLevel = Checks::Light, Stats statLevel = Stats::On>
+	struct SmallPolicy : AllocatorPolicy<checkLevel, statLevel>
+	{
+		using Size = uint16_t;
+		using Ref = uint16_t;
+		template<typename T> using RefTable = PagedVector<T, 64>; // a 1024 entry page would rival a small pool
+	};
+
+	/* Policy for static images: the pool and ref table live inside the collector object, which
+	 * is constant initialized to all zero bytes, so a global one sits in .bss, costs nothing at
+	 * startup, and never allocates. The heap is set up on first use.
+	 */
+	template<uint32_t heapBytes, uint32_t refCount, Checks checkLevel = Checks::Light, Stats statLevel = Stats::On>
+	struct StaticPolicy : AllocatorPolicy<checkLevel, statLevel>
+	{
+		static constexpr uint32_t poolBytes = heapBytes;
+		template<typename T> using RefTable = FixedVector<T, refCount>;
+	};
+
 	/* Simple, decent memory allocator from fixed pool.
 	 * Provides AllocPtr and FreePtr
 	 */
-	class Allocator
+	template<typename Policy = AllocatorPolicy<>>
+	class BasicAllocator
 	{
 	public:
-		using Size = uint32_t; // size of block, or offset from base memory
+		using Size = typename Policy::Size; // size of block, or offset from base memory
+		static_assert(std::is_unsigned_v<Size> && sizeof(Size) <= sizeof(uint32_t), "Size must be an unsigned type of at most 32 bits");
 
 	protected:
 #pragma pack(push,1)
+		static constexpr bool tinyChunks = Policy::tinyChunks;
+		static constexpr bool staticPool = Policy::poolBytes != 0;
+		static_assert(!tinyChunks || sizeof(Size) == 4, "tiny chunks need 32 bit Size, 16 bit Size already has 8 byte chunks");
+
 		// this struct used to point to a chunk of memory
 		struct Chunk {
 		private:
 			Size size{0};     // size in bytes, including overhead, low bit is isPrevUsed (when bit = 1)
+			                  // with tiny chunks, bit 1 is isPrevTiny (prev is a free tiny chunk, with no footer)
 		public:
-			Size nextOffset{ 0 }, prevOffset{0}; // double linked list if this node free
-			static constexpr Size sizeMask = static_cast<Size>(-1) ^ 1;
+			Size nextOffset{ 0 }, prevOffset{0}; // double linked list if this node free, not present in tiny chunks
+			static constexpr Size flagMask = tinyChunks ? 3 : 1;
+			static constexpr Size sizeMask = static_cast<Size>(-1) ^ flagMask;
 			[[nodiscard]] Size GetSize() const { return size & sizeMask; }
 			void SetSize(const Size newSize)
 			{
-				const bool prevUsed = IsPrevUsed();
-				size = newSize;
-				SetPrevUsed(prevUsed);
+				size = (size & flagMask) | newSize;
 			}
 
 			[[nodiscard]] bool IsPrevUsed() const { return (size & 1) == 1; }
 			void SetPrevUsed(const bool prevUsed)
 			{
-				size &= sizeMask;
+				size &= sizeMask; // a used prev is never tiny
 				if (prevUsed) size |= 1;
 			}
+
+			[[nodiscard]] bool IsPrevTiny() const { return tinyChunks && (size & 2) == 2; }
+			void SetPrevTiny(const bool prevTiny)
+			{
+				if constexpr (tinyChunks)
+				{
+					size &= static_cast<Size>(-1) ^ 2;
+					if (prevTiny) size |= 2;
+				}
+			}
 		};
 
 		// bin sizes: 2=1*2 through 32=16*2 is 16 entries, then all go after that
@@ -81,12 +536,11 @@ namespace Lomont::Languages {
 
 		struct FreeChunkBins
 		{
-			Size bins[BIN_INDICES]{}; // offsets to some size bins
+			Size bins[BIN_INDICES]{}; // offsets to some size bins, all InvalidSize once the heap is set up
 			// sizes: Evens 2=1*2 through 30=15*2, then 
 
-			FreeChunkBins() { std::fill_n(bins, BIN_INDICES, Allocator::InvalidSize); }
 			// get index where this size lives
-			static int GetIndex(Size bytesRequested)
+			static constexpr int GetIndex(Size bytesRequested)
 			{
 				if (bytesRequested < 33)
 					return (bytesRequested - 1) / 2;
@@ -95,8 +549,103 @@ namespace Lomont::Languages {
 		};
 #pragma pack(pop)
 
-		// round size up to even
-		static constexpr Size RoundUp(Size size) { return size + (size & 1); }
+		// chunk sizes are multiples of this, leaving the low size bits for flags
+		static constexpr Size Granularity = tinyChunks ? 4 : 2;
+
+		// round size up to a multiple of Granularity
+		static constexpr Size RoundUp(Size size) { return (size + Granularity - 1) & ~(Granularity - 1); }
+
+		/* Tiny chunks: with Policy::tinyChunks, a chunk can be TinySize bytes, which holds
+		 * a 4 byte object. Free chunks smaller than a full Chunk plus footer have no room for
+		 * full links, so store their bin links as 16 bit offsets in Granularity units after
+		 * the header. A free TinySize chunk also has no footer, so the following chunk's
+		 * isPrevTiny bit stands in for it.
+		 */
+		static constexpr Size TinySize = 2 * sizeof(Size);
+		static constexpr uint32_t MaxTinyPoolSize = 0xFFFFu * Granularity;
+
+		// smallest chunk, used or free
+		static constexpr Size MinChunkSize = tinyChunks ? TinySize : RoundUp(sizeof(Chunk) + sizeof(Size));
+
+		/* Quick lists: with Policy::quickListBytes, FreePtr parks a freed chunk of at most that
+		 * size on a list of chunks of exactly its size. The chunk stays marked used, so there is
+		 * no header rewrite and no merge, and the next AllocPtr of that size pops it back.
+		 * Parked chunks are freed for real, with merges, when the bins cannot satisfy a request,
+		 * and at safe points such as compaction. Lists link through the first Size bytes of the
+		 * block, holding the next chunk's offset plus 1, so 0 is the empty list.
+		 */
+		static constexpr uint32_t quickListBytes = Policy::quickListBytes;
+		static constexpr bool quickOn = quickListBytes >= MinChunkSize;
+		static constexpr uint32_t QuickClasses = quickOn ? (quickListBytes - MinChunkSize) / Granularity + 1 : 1;
+		static_assert(quickListBytes <= 4096, "Quick lists are for small chunks");
+		static constexpr uint32_t QuickIndex(Size chunkSize) { return (chunkSize - MinChunkSize) / Granularity; }
+
+		// free chunk has no footer
+		static bool IsTiny(const Chunk* chunk) { return tinyChunks && chunk->GetSize() == TinySize; }
+		// free chunk has 16 bit links
+		static bool HasShortLinks(const Chunk* chunk) { return tinyChunks && chunk->GetSize() < sizeof(Chunk) + sizeof(Size); }
+
+		// free list links, stored compactly in tiny chunks
+		static Size NextOf(const Chunk* chunk) { return GetLink(chunk, 0); }
+		static Size PrevOf(const Chunk* chunk) { return GetLink(chunk, 1); }
+		static void SetNext(Chunk* chunk, Size offset) { SetLink(chunk, 0, offset); }
+		static void SetPrev(Chunk* chunk, Size offset) { SetLink(chunk, 1, offset); }
+
+		static Size GetLink(const Chunk* chunk, int which)
+		{
+			if (HasShortLinks(chunk))
+			{
+				uint16_t link;
+				std::memcpy(&link, reinterpret_cast<const uint8_t*>(chunk) + sizeof(Size) + which * sizeof(uint16_t), sizeof(link));
+				return static_cast<Size>(link) * Granularity;
+			}
+			return which == 0 ? chunk->nextOffset : chunk->prevOffset;
+		}
+		static void SetLink(Chunk* chunk, int which, Size offset)
+		{
+			if (HasShortLinks(chunk))
+			{
+				const auto link = static_cast<uint16_t>(offset / Granularity);
+				std::memcpy(reinterpret_cast<uint8_t*>(chunk) + sizeof(Size) + which * sizeof(uint16_t), &link, sizeof(link));
+			}
+			else if (which == 0)
+				chunk->nextOffset = offset;
+			else
+				chunk->prevOffset = offset;
+		}
+
+		static constexpr bool checksOn = Policy::checks != Checks::None;
+		static constexpr bool paranoid = Policy::checks == Checks::Paranoid;
+		static constexpr bool statsOn = Policy::stats == Stats::On;
+		static constexpr bool traceOn = Policy::Tracer::enabled;
+
+		// tracing hooks, compile to nothing unless tracing enabled
+		void TraceBegin([[maybe_unused]] TraceEvent event)
+		{
+			if constexpr (traceOn) tracer.Begin(event);
+		}
+		void TraceEnd([[maybe_unused]] TraceEvent event, [[maybe_unused]] uint64_t bytes)
+		{
+			if constexpr (traceOn) tracer.End(event, bytes);
+		}
+		void TraceInstant([[maybe_unused]] TraceEvent event, [[maybe_unused]] uint64_t bytes)
+		{
+			if constexpr (traceOn) tracer.Instant(event, bytes);
+		}
+
+		// assert, unless checks compiled out
+		static void Assert([[maybe_unused]] bool ok)
+		{
+			if constexpr (checksOn)
+				assert(ok);
+		}
+
+		// paranoid mode places these bytes at the end of each used chunk
+		static constexpr Size guardBytes = paranoid ? sizeof(Size) : 0;
+		static constexpr Size guardValue = static_cast<Size>(0xFDFDFDFDu);
+		static constexpr Size quickGuardValue = static_cast<Size>(0xFBFBFBFBu); // parked on a quick list
+		// smallest chunk that can be parked, header and link before any guard
+		static constexpr Size MinQuickChunk = 2 * sizeof(Size) + guardBytes;
 
 
 	public:
@@ -104,74 +653,251 @@ namespace Lomont::Languages {
 		 * \brief Create a memory allocator that holds a fixed block of the requested size
 		 * \param sizeInBytes The number of bytes to manage.
 		 */
-		Allocator(Size sizeInBytes)
+		BasicAllocator(uint32_t sizeInBytes) requires (!staticPool)
 		{
-			memory.resize(sizeInBytes);
-
-			// set all into a free node, chop off top item in struct
-			Chunk* root = GetChunkAbsolute(0);
-			WriteHeaderAndFooter(root, RoundUp(sizeInBytes - 1), false);
-			root->nextOffset = root->prevOffset = 0; // loop to self
-			freeBlocks = 1;
-			freeMem = sizeInBytes;
-
-			// link into bins
-			AddToFreeList(root);
+			sizeInBytes &= ~static_cast<uint32_t>(Granularity - 1); // whole chunks only
+			if (sizeInBytes > MaxPoolSize)
+				throw std::runtime_error("Pool too large for Size");
+			memory.Allocate(sizeInBytes); // left uninitialized, only the root chunk is written
+			InitRoot();
 		}
 
+		/**
+		 * \brief Create a memory allocator holding Policy::poolBytes inside the object.
+		 * Constant initialized, the heap is set up on first use.
+		 */
+		constexpr BasicAllocator() requires staticPool = default;
+
 		/**
 		 * \brief Allocate memory
 		 * \param byteSizeRequested the number of bytes requested
+		 * \param placement Placement::Hot takes the lowest of a few fitting chunks, and carves from its bottom
 		 * \return a pointer to the memory, or nullptr if not available.
 		 */
-		void* AllocPtr(Size byteSizeRequested)
+		void* AllocPtr(Size byteSizeRequested, Placement placement = Placement::Cold)
+		{
+			return AllocBlock(byteSizeRequested, 0, placement);
+		}
+
+		/**
+		 * \brief free the pointer, back into the Allocator pool
+		 * \param userData a pointer to the block to free
+		 */
+		void FreePtr(void* userData)
+		{
+			Assert(userData != InvalidAlloc);
+
+
+			const auto chunk = reinterpret_cast<Chunk*>(static_cast<uint8_t*>(userData) - userDeltaBytes);
+			if constexpr (paranoid)
+				CheckUsedChunk(chunk);
+			if (quickOn && chunk->GetSize() <= quickListBytes && chunk->GetSize() >= MinQuickChunk)
+				PushQuick(chunk); // merged later
+			else
+				FreeChunk(chunk);
+			if constexpr (statsOn) ++frees;
+		}
+
+		/**
+		 * \brief Free and merge all chunks parked on quick lists, see Policy::quickListBytes.
+		 * AllocPtr does this when the bins cannot satisfy a request, and compaction does it
+		 * first, so only call it to defragment the free lists at some other safe point.
+		 * ForEachChunk reports parked chunks as free without flushing them.
+		 * \return the number of chunks freed
+		 */
+		uint32_t FlushQuickLists()
+		{
+			uint32_t count = 0;
+			if constexpr (quickOn)
+				for (auto index = 0u; index < QuickClasses; ++index)
+					while (const auto chunk = PopQuick(static_cast<Size>(MinChunkSize + index * Granularity)))
+					{
+						FreeChunk(chunk);
+						++count;
+					}
+			return count;
+		}
+
+		/**
+		 * \brief Free every block at once, in constant time, by making the whole pool one free
+		 * chunk again. Pointers into the pool are invalid afterwards. Blocks queued by
+		 * RemoteFreePtr are dropped, so no other thread may be freeing during the call.
+		 */
+		void Reset()
+		{
+			remoteFrees.store(0, std::memory_order_relaxed);
+			std::fill(std::begin(quickLists), std::end(quickLists), Size{ 0 });
+			compactCursor = checkCursor = 0;
+			sweepFreeBlocks = sweepUsedBlocks = sweepFreeMem = sweepUsedMem = 0;
+			std::fill(std::begin(sweepBinChunks), std::end(sweepBinChunks), 0u);
+			if constexpr (statsOn)
+			{
+				frees += usedBlocks; // parked blocks were counted when parked
+				usedBlocks = usedMem = quickBlocks = quickMem = 0;
+			}
+			InitRoot();
+		}
+
+		/**
+		 * \brief Free a pointer from a thread that does not own this allocator. Lock free.
+		 * The block is queued through its own memory, and freed by the owning thread in a
+		 * batch on its next AllocPtr or DrainRemoteFrees.
+		 * \param userData a pointer to the block to free
+		 */
+		void RemoteFreePtr(void* userData)
+		{
+			Assert(userData != InvalidAlloc);
+			PushRemote(remoteFrees, static_cast<uint8_t*>(userData));
+		}
+
+		/**
+		 * \brief Free all blocks queued by RemoteFreePtr. Only call from the owning thread.
+		 * \return the number of blocks freed
+		 */
+		uint32_t DrainRemoteFrees()
+		{
+			return DrainRemote(remoteFrees, [this](uint8_t* userData) { FreePtr(userData); });
+		}
+
+		constexpr static Size* InvalidAlloc { nullptr };
+
+		// receives trace events, see NullTracer
+		[[no_unique_address]] typename Policy::Tracer tracer;
+
+		// lots of stats, only updated when Policy::stats is Stats::On
+		uint32_t freeBlocks{ 0 }, usedBlocks{ 0 }, freeMem{ 0 }, usedMem{ 0 }, merges{ 0 };
+		// , collections{ 0 }, swaps{ 0 }, bytesMoved{ 0 };
+		uint32_t allocations{ 0 }, frees{ 0 }, fails{ 0 };
+		uint32_t bytesAllocated{ 0 }; // total chunk bytes handed out, wraps
+		uint32_t quickBlocks{ 0 }, quickMem{ 0 }; // freed chunks parked on quick lists, in neither used nor free
+
+		/**
+		 * \brief The size of the managed memory
+		 * \return The size of the managed memory
+		 */
+		[[nodiscard]] Size size() const { return static_cast<Size>(memory.size()); }
+
+		constexpr static uint32_t InvalidOwner{ static_cast<uint32_t>(-1) };
+
+		// one chunk of the heap, see ForEachChunk
+		struct ChunkInfo
+		{
+			Size offset;    // offset from base of memory to the chunk header
+			Size size;      // size in bytes, including overhead
+			bool used;
+			uint32_t owner; // owning Ref for a GarbageCollector, else InvalidOwner
+		};
+
+		/**
+		 * \brief Visit each chunk in address order. Chunks parked on quick lists are reported
+		 * free, though not merged with free neighbors, and the heap is left unchanged.
+		 * \param visit called with a const ChunkInfo& for each chunk
+		 */
+		template<typename Visitor>
+		void ForEachChunk(Visitor&& visit)
+		{
+			EnsureRoot();
+			// parked chunks look used, so gather their offsets, in address order
+			std::vector<Size> parked;
+			if constexpr (quickOn)
+			{
+				for (auto head : quickLists)
+					for (; head != 0; std::memcpy(&head, reinterpret_cast<uint8_t*>(GetChunkAbsolute(head - 1)) + userDeltaBytes, sizeof(Size)))
+						parked.push_back(head - 1);
+				std::sort(parked.begin(), parked.end());
+			}
+			auto nextParked = parked.begin();
+			Chunk* s = GetChunkAbsolute(0);
+			while (s != nullptr)
+			{
+				const auto offset = OffsetOf(s);
+				const bool isParked = nextParked != parked.end() && *nextParked == offset;
+				if (isParked)
+					++nextParked;
+				const ChunkInfo info{ offset, s->GetSize(), IsSelfUsed(s) && !isParked, InvalidOwner };
+				visit(info);
+				s = NextChunk(s);
+			}
+		}
+
+
+	protected:
+		FreeChunkBins chunkBins;
+
+		// AllocPtr, with trailerBytes more at the end of the block for the caller's bookkeeping,
+		// such as a GarbageCollector's owner Ref. Traces and Tracer::largeAllocBytes see only byteSizeRequested
+		void* AllocBlock(Size byteSizeRequested, Size trailerBytes, Placement placement)
 		{
-			auto bytesNeeded = RoundUp(byteSizeRequested + sizeof(Size));       // used chunk size
-			constexpr auto minFreeSize = RoundUp(sizeof(Chunk) + sizeof(Size)); // min free block
+			EnsureRoot();
+			if (remoteFrees.load(std::memory_order_relaxed) != 0)
+				DrainRemoteFrees();
+
+			auto bytesNeeded = RoundUp(byteSizeRequested + trailerBytes + sizeof(Size) + guardBytes); // used chunk size
+			constexpr auto minFreeSize = MinChunkSize; // min free block
 			if (bytesNeeded < minFreeSize)
 				bytesNeeded = minFreeSize;
+			const bool fits = static_cast<uint32_t>(byteSizeRequested) + trailerBytes + sizeof(Size) + guardBytes < size(); // else bytesNeeded wrapped
+
+			if constexpr (quickOn)
+				if (fits && bytesNeeded <= quickListBytes)
+					if (const auto parked = PopQuick(bytesNeeded))
+					{ // still marked used, nothing to rewrite
+						if constexpr (paranoid)
+							WriteGuard(parked);
+						if constexpr (statsOn)
+						{
+							bytesAllocated += bytesNeeded;
+							allocations++;
+						}
+						return reinterpret_cast<uint8_t*>(parked) + userDeltaBytes;
+					}
 
-			Chunk* curFree = GetFreeOfSize(bytesNeeded);
+			const bool bottom = placement == Placement::Hot;
+			Chunk* curFree = fits ? GetFreeOfSize(bytesNeeded, bottom) : nullptr;
+			if constexpr (quickOn)
+				if (curFree == nullptr && fits && FlushQuickLists() != 0)
+					curFree = GetFreeOfSize(bytesNeeded, bottom);
 			if (!curFree) {
-				++fails;
+				if constexpr (statsOn) ++fails;
+				TraceInstant(TraceEvent::AllocFail, byteSizeRequested);
 				return InvalidAlloc;
 			}
+			if constexpr (traceOn)
+				if (byteSizeRequested >= Policy::Tracer::largeAllocBytes)
+					TraceInstant(TraceEvent::LargeAlloc, byteSizeRequested);
 
 			const auto size = curFree->GetSize();
-			assert(size >= bytesNeeded);
+			Assert(size >= bytesNeeded);
 
 			RemoveFromFreeList(curFree); // remove from current list
 
 			const auto splitBlock = size >= minFreeSize + bytesNeeded;
 			const Size bytesUsed = splitBlock ? bytesNeeded : size;
 
-			const auto used = PlaceChunkRelative(curFree, static_cast<int32_t>(size) - bytesUsed);
+			// hot blocks from the bottom of the free chunk, cold from the top
+			const auto used = bottom ? curFree : PlaceChunkRelative(curFree, static_cast<int32_t>(size) - bytesUsed);
 			// must write this block before any potential free chunk before it
 			WriteHeaderAndFooter(used, bytesUsed, true);
+			if constexpr (paranoid)
+				WriteGuard(used);
 
 			AllocationBytesUsed(static_cast<int>(bytesUsed));
 
 			if (splitBlock)
 			{
-				++freeBlocks;
-				WriteHeaderAndFooter(curFree, size - bytesUsed, false);
-				AddToFreeList(curFree);
+				if constexpr (statsOn) ++freeBlocks;
+				const auto rest = bottom ? PlaceChunkRelative(curFree, static_cast<int32_t>(bytesUsed)) : curFree;
+				WriteHeaderAndFooter(rest, size - bytesUsed, false);
+				AddToFreeList(rest);
 			}
 
-			allocations++;
+			if constexpr (statsOn) allocations++;
 			return reinterpret_cast<uint8_t*>(used) + userDeltaBytes; // skip header
 		}
 
-		/**
-		 * \brief free the pointer, back into the Allocator pool
-		 * \param userData a pointer to the block to free
-		 */
-		void FreePtr(void* userData)
+		// mark a used chunk free, add it to the bins, and merge with free neighbors
+		void FreeChunk(Chunk* chunk)
 		{
-			assert(userData != InvalidAlloc);
-
-
-			const auto chunk = reinterpret_cast<Chunk*>(static_cast<uint8_t*>(userData) - userDeltaBytes);
 			const auto size = chunk->GetSize();
 			WriteHeaderAndFooter(chunk, size, false);
 			AddToFreeList(chunk);
@@ -182,27 +908,54 @@ namespace Lomont::Languages {
 			if (!IsNextUsed(chunk))
 				MergeSecondIntoFirst(chunk, NextChunk(chunk));
 
+			auto freed = chunk;
 			if (!chunk->IsPrevUsed() && OffsetOf(chunk) != 0)
-				MergeSecondIntoFirst(PrevChunk(chunk), chunk);
-			++frees;
+			{
+				freed = PrevChunk(chunk);
+				MergeSecondIntoFirst(freed, chunk);
+			}
+			if (OffsetOf(freed) < compactCursor)
+				compactCursor = OffsetOf(freed); // keep all below cursor used
 		}
 
-		constexpr static Size* InvalidAlloc { nullptr };
-
-		// lots of stats
-		uint32_t freeBlocks{ 0 }, usedBlocks{ 0 }, freeMem{ 0 }, usedMem{ 0 }, merges{ 0 };
-		// , collections{ 0 }, swaps{ 0 }, bytesMoved{ 0 };
-		uint32_t allocations{ 0 }, frees{ 0 }, fails{ 0 };
+		// quick list heads by chunk size, next chunk offset plus 1, see quickListBytes
+		Size quickLists[QuickClasses]{};
 
-		/**
-		 * \brief The size of the managed memory
-		 * \return The size of the managed memory
-		 */
-		[[nodiscard]] Size size() const { return static_cast<Size>(memory.size()); }
+		// park a freed chunk on the quick list for its size, leaving it marked used
+		void PushQuick(Chunk* chunk)
+		{
+			auto& head = quickLists[QuickIndex(chunk->GetSize())];
+			std::memcpy(reinterpret_cast<uint8_t*>(chunk) + userDeltaBytes, &head, sizeof(Size));
+			head = OffsetOf(chunk) + 1;
+			if constexpr (paranoid)
+				WriteGuard(chunk, quickGuardValue); // so freeing it again is caught
+			QuickBytesParked(static_cast<int>(chunk->GetSize()));
+		}
 
+		// take a parked chunk of exactly this size, nullptr if none
+		Chunk* PopQuick(Size chunkSize)
+		{
+			auto& head = quickLists[QuickIndex(chunkSize)];
+			if (head == 0)
+				return nullptr;
+			const auto chunk = GetChunkAbsolute(head - 1);
+			std::memcpy(&head, reinterpret_cast<uint8_t*>(chunk) + userDeltaBytes, sizeof(Size));
+			QuickBytesParked(-static_cast<int>(chunkSize));
+			return chunk;
+		}
 
-	protected:
-		FreeChunkBins chunkBins;
+		// move chunk bytes between used and parked stats
+		void QuickBytesParked(int bytes)
+		{
+			if constexpr (statsOn)
+			{
+				const auto s = bytes > 0 ? 1 : -1;
+				usedBlocks -= s;
+				usedMem -= bytes;
+				quickBlocks += s;
+				quickMem += bytes;
+			}
+		}
 
 		void AddToFreeList(Chunk* chunk)
 		{
@@ -213,18 +966,42 @@ namespace Lomont::Languages {
 			if (listIndex == InvalidSize)
 			{ // single node
 				chunkBins.bins[binIndex] = offset;
-				chunk->prevOffset = chunk->nextOffset = offset;
+				SetPrev(chunk, offset);
+				SetNext(chunk, offset);
+			}
+			else if constexpr (Policy::freeList == FreeList::AfterHead)
+			{ // just after the head
+				LinkBefore(chunk, GetChunkAbsolute(NextOf(GetChunkAbsolute(listIndex))));
+			}
+			else if constexpr (Policy::freeList == FreeList::Lifo)
+			{ // new head
+				LinkBefore(chunk, GetChunkAbsolute(listIndex));
+				chunkBins.bins[binIndex] = offset;
 			}
 			else
-			{ // link in 			
-				const auto listNode = GetChunkAbsolute(listIndex);
-				const auto nextNode = GetChunkAbsolute(listNode->nextOffset);
-				chunk->prevOffset = listIndex;
-				chunk->nextOffset = listNode->nextOffset;
-				nextNode->prevOffset = offset;
-				listNode->nextOffset = offset;
+			{ // before the first higher chunk, head is lowest
+				auto node = GetChunkAbsolute(listIndex);
+				while (OffsetOf(node) < offset && NextOf(node) != listIndex)
+					node = GetChunkAbsolute(NextOf(node));
+				if (OffsetOf(node) < offset)
+					LinkBefore(chunk, GetChunkAbsolute(listIndex)); // highest, goes at the tail
+				else
+					LinkBefore(chunk, node);
+				if (offset < listIndex)
+					chunkBins.bins[binIndex] = offset;
 			}
 		}
+
+		// link chunk into a bin ring just before node
+		void LinkBefore(Chunk* chunk, Chunk* node)
+		{
+			const auto offset = OffsetOf(chunk);
+			const auto prev = GetChunkAbsolute(PrevOf(node));
+			SetNext(chunk, OffsetOf(node));
+			SetPrev(chunk, OffsetOf(prev));
+			SetNext(prev, offset);
+			SetPrev(node, offset);
+		}
 		// remove chunk, leave chunk offsets to next, prev unchanged
 		void RemoveFromFreeList(Chunk* chunk)
 		{
@@ -232,16 +1009,20 @@ namespace Lomont::Languages {
 			const int binIndex = FreeChunkBins::GetIndex(chunk->GetSize());
 			if (chunkBins.bins[binIndex] == offset)
 			{ // must deal with it
-				chunkBins.bins[binIndex] = chunk->nextOffset == offset ? InvalidSize : chunk->nextOffset;
+				chunkBins.bins[binIndex] = NextOf(chunk) == offset ? InvalidSize : NextOf(chunk);
 			}
 			// unlink it
-			GetChunkAbsolute(chunk->nextOffset)->prevOffset = chunk->prevOffset;
-			GetChunkAbsolute(chunk->prevOffset)->nextOffset = chunk->nextOffset;
+			SetPrev(GetChunkAbsolute(NextOf(chunk)), PrevOf(chunk));
+			SetNext(GetChunkAbsolute(PrevOf(chunk)), NextOf(chunk));
 		}
 
 
-		// get the first free one with the requested size
-		Chunk* GetFreeOfSize(Size bytesRequested)
+		// fitting chunks a Placement::Hot request compares, taking the lowest, see GetFreeOfSize
+		static constexpr uint32_t HotCandidates = 8;
+
+		// get the first free one with the requested size, or for lowest, the lowest addressed
+		// of the first few fitting ones in that bin, so hot blocks drift to the bottom of the heap
+		Chunk* GetFreeOfSize(Size bytesRequested, bool lowest = false)
 		{
 			int binIndex = FreeChunkBins::GetIndex(bytesRequested);
 
@@ -252,11 +1033,22 @@ namespace Lomont::Languages {
 				{ // todo - keep bins sorted? check size? then no need to loop here
 					auto cur = GetChunkAbsolute(offset);
 					const auto start = cur;
+					Chunk* best = nullptr;
+					uint32_t candidates = 0;
 					do {
 						if (cur->GetSize() >= bytesRequested)
-							return cur;
-						cur = GetChunkAbsolute(cur->nextOffset);
+						{
+							if (!lowest)
+								return cur;
+							if (best == nullptr || cur < best)
+								best = cur;
+							if (++candidates == HotCandidates)
+								break;
+						}
+						cur = GetChunkAbsolute(NextOf(cur));
 					} while (cur != start);
+					if (best != nullptr)
+						return best;
 				}
 				binIndex++;
 			}
@@ -264,18 +1056,26 @@ namespace Lomont::Languages {
 		}
 
 		static constexpr Size InvalidSize{static_cast<Size>(-1)};
+		// largest pool, so every offset fits in Size and differs from InvalidSize
+		static constexpr uint32_t MaxPoolSize = tinyChunks ? MaxTinyPoolSize : InvalidSize & ~static_cast<uint32_t>(Granularity - 1);
+		static_assert(Policy::poolBytes % Granularity == 0 && Policy::poolBytes <= MaxPoolSize, "Static pool must be whole chunks that fit in Size");
+		static_assert(!staticPool || Policy::poolBytes >= MinChunkSize, "Static pool too small");
 
 		// write header and possible footer and any following IsPrevUsed flag
 		void WriteHeaderAndFooter(Chunk* chunk, Size size, bool isUsed)
 		{
-			assert(size >= sizeof(Size));
+			Assert(size >= sizeof(Size));
 			chunk->SetSize(size);
+			const bool tiny = !isUsed && IsTiny(chunk);
 			if (const auto next = NextChunk(chunk))
+			{
 				next->SetPrevUsed(isUsed);
+				next->SetPrevTiny(tiny);
+			}
 			else
 				finalPrevIsUsed = isUsed;
 
-			if (!isUsed)
+			if (!isUsed && !tiny)
 			{
 				// footer
 				const auto dst = reinterpret_cast<Size*>(reinterpret_cast<uint8_t*>(chunk) + chunk->GetSize() - sizeof(Size));
@@ -305,7 +1105,12 @@ namespace Lomont::Languages {
 		}
 
 		// only valid on chunk with prev free
-		static Size PrevSize(Chunk* chunk) { return *(reinterpret_cast<Size*>(chunk) - 1); }
+		static Size PrevSize(Chunk* chunk)
+		{
+			if (chunk->IsPrevTiny())
+				return TinySize; // tiny chunks have no footer
+			return *(reinterpret_cast<Size*>(chunk) - 1);
+		}
 
 		// return prev chunk if cur is free and not 0 offset from base
 		// else nullptr
@@ -322,10 +1127,18 @@ namespace Lomont::Languages {
 		{ // merge prev chunk into this one
 			RemoveFromFreeList(prev);
 			RemoveFromFreeList(chunk);
+			if (checkCursor == OffsetOf(chunk))
+				checkCursor = OffsetOf(prev); // second chunk no longer exists
+			if (compactCursor == OffsetOf(chunk))
+				compactCursor = OffsetOf(prev);
 			WriteHeaderAndFooter(prev, prev->GetSize() + chunk->GetSize(), false);
 			AddToFreeList(prev);
-			freeBlocks--;
-			++merges;
+			if constexpr (statsOn)
+			{
+				freeBlocks--;
+				++merges;
+			}
+			TraceInstant(TraceEvent::Merge, prev->GetSize());
 		}
 		// see if next us used.
 		// if last chunk possible, return true to mark used
@@ -339,15 +1152,65 @@ namespace Lomont::Languages {
 			return true;
 		}
 
-		constexpr static int userDeltaBytes = sizeof(Size);// should be sizeof(Size)
+		// is this chunk in use? stored in the next chunk, or for the last chunk, in finalPrevIsUsed
+		bool IsSelfUsed(Chunk* chunk) const
+		{
+			Assert(chunk != nullptr);
+			if (const auto next = NextChunk(chunk)) return next->IsPrevUsed();
+			return finalPrevIsUsed;
+		}
+
+		constexpr static int userDeltaBytes = sizeof(Size);// should be sizeof(Size)
+
+		void AllocationBytesUsed(int bytesUsed)
+		{
+			if constexpr (statsOn)
+			{
+				const auto s = bytesUsed > 0 ? 1 : -1;
+				freeBlocks -= s;
+				usedBlocks += s;
+				freeMem -= bytesUsed;
+				usedMem += bytesUsed;
+				if (bytesUsed > 0) bytesAllocated += bytesUsed;
+			}
+			checkSweepClean = false; // heap changed under any incremental check
+		}
+
+		// paranoid mode: stamp the guard at the end of a used chunk
+		static void WriteGuard(Chunk* chunk, Size value = guardValue)
+		{
+			const auto dst = reinterpret_cast<uint8_t*>(chunk) + chunk->GetSize() - guardBytes;
+			std::memcpy(dst, &value, guardBytes);
+		}
+
+		// paranoid mode: true if guard at the end of a used chunk is intact
+		static bool GuardIntact(Chunk* chunk, Size value = guardValue)
+		{
+			Size guard;
+			std::memcpy(&guard, reinterpret_cast<uint8_t*>(chunk) + chunk->GetSize() - guardBytes, guardBytes);
+			return guard == value;
+		}
 
-		void AllocationBytesUsed(int bytesUsed)
+		// paranoid mode: true if a used chunk, or one parked on a quick list, is intact
+		static bool GuardOrParkedIntact(Chunk* chunk)
 		{
-			const auto s = bytesUsed > 0 ? 1 : -1;
-			freeBlocks -= s;
-			usedBlocks += s;
-			freeMem -= bytesUsed;
-			usedMem += bytesUsed;
+			return GuardIntact(chunk) || (quickOn && GuardIntact(chunk, quickGuardValue));
+		}
+
+		// paranoid mode: validate a chunk being freed, catching overruns, double frees, and wild pointers
+		void CheckUsedChunk(Chunk* chunk)
+		{
+			const auto base = reinterpret_cast<uint8_t*>(GetChunkAbsolute(0));
+			const auto ptr = reinterpret_cast<uint8_t*>(chunk);
+			if (ptr < base || ptr >= base + size())
+				throw std::runtime_error("Pointer not in pool");
+			const auto chunkSize = chunk->GetSize();
+			if (chunkSize < MinChunkSize || chunkSize > size() - OffsetOf(chunk))
+				throw std::runtime_error("Bad chunk size");
+			if (!IsSelfUsed(chunk) || (quickOn && GuardIntact(chunk, quickGuardValue)))
+				throw std::runtime_error("Double free");
+			if (!GuardIntact(chunk))
+				throw std::runtime_error("Guard bytes overwritten");
 		}
 
 
@@ -355,19 +1218,19 @@ namespace Lomont::Languages {
 		// some per chunk integrity checking
 		void CheckChunk(Chunk* chunk)
 		{
-			if (chunk->GetSize() < 16)
+			if (chunk->GetSize() < MinChunkSize)
 				throw std::runtime_error("Size too small");
 			const auto next = NextChunk(chunk);
 			if (next && !next->IsPrevUsed())
 			{
-				if (chunk->nextOffset == InvalidSize ||
-					chunk->prevOffset == InvalidSize)
+				if (NextOf(chunk) == InvalidSize ||
+					PrevOf(chunk) == InvalidSize)
 					throw std::runtime_error("Bad free pointers");
 
 				const auto offset = OffsetOf(chunk);
 				if (
-					GetChunkAbsolute(chunk->nextOffset)->prevOffset != offset ||
-					GetChunkAbsolute(chunk->prevOffset)->nextOffset != offset
+					PrevOf(GetChunkAbsolute(NextOf(chunk))) != offset ||
+					NextOf(GetChunkAbsolute(PrevOf(chunk))) != offset
 					)
 					throw std::runtime_error("Bad back links");
 			}
@@ -388,8 +1251,11 @@ namespace Lomont::Languages {
 			do {
 				++count;
 				found |= cur == chunk;
-				cur = GetChunkAbsolute(cur->nextOffset);
-				if (count > freeBlocks * 10)
+				if constexpr (Policy::freeList == FreeList::AddressOrdered)
+					if (NextOf(cur) != startOffset && NextOf(cur) < OffsetOf(cur))
+						throw std::runtime_error("Bin out of address order");
+				cur = GetChunkAbsolute(NextOf(cur));
+				if (count > size())
 					break; // have error!
 			} while (cur != start);
 			if (!found)
@@ -397,10 +1263,82 @@ namespace Lomont::Languages {
 			return count;
 		}
 
+		// ensure free chunk is linked into the correct bin without walking the bin.
+		// The bin tag of a chunk is its size class, so every node on a bin ring must
+		// share the tag of its neighbors, and the neighbors must link back to it.
+		void CheckBinLinks(Chunk* chunk)
+		{
+			const auto offset = OffsetOf(chunk);
+			const auto binIndex = FreeChunkBins::GetIndex(chunk->GetSize());
+			if (chunkBins.bins[binIndex] == InvalidSize)
+				throw std::runtime_error("chunk missing in bin");
+			if (NextOf(chunk) >= size() || PrevOf(chunk) >= size())
+				throw std::runtime_error("Bad free pointers");
+			const auto next = GetChunkAbsolute(NextOf(chunk));
+			const auto prev = GetChunkAbsolute(PrevOf(chunk));
+			if (PrevOf(next) != offset || NextOf(prev) != offset)
+				throw std::runtime_error("Bad back links");
+			if (FreeChunkBins::GetIndex(next->GetSize()) != binIndex ||
+				FreeChunkBins::GetIndex(prev->GetSize()) != binIndex)
+				throw std::runtime_error("Chunk linked into wrong bin");
+			if (IsSelfUsed(next) || IsSelfUsed(prev))
+				throw std::runtime_error("Used chunk in bin");
+		}
+
+		// number of chunks on a bin's ring, walked from its head, stopping early if the ring is broken
+		uint32_t CountBin(int binIndex)
+		{
+			const auto head = chunkBins.bins[binIndex];
+			if (head == InvalidSize)
+				return 0;
+			uint32_t count = 0;
+			auto offset = head;
+			do {
+				if (offset >= size() || IsSelfUsed(GetChunkAbsolute(offset)))
+					throw std::runtime_error("Bad bin head");
+				offset = NextOf(GetChunkAbsolute(offset));
+				if (++count > size())
+					break; // a loop not through the head, CheckBinLinks catches its members
+			} while (offset != head);
+			return count;
+		}
+
+		// heads of lock free lists of blocks freed by other threads, linked through the
+		// first Size bytes of each block, holding the offset of the next block's chunk plus 1,
+		// so 0 is the empty list
+		std::atomic<Size> remoteFrees{ 0 };
+
+		// push block onto a remote free list, safe from any thread
+		void PushRemote(std::atomic<Size>& head, uint8_t* userData)
+		{
+			const Size link = OffsetOf(reinterpret_cast<Chunk*>(userData - userDeltaBytes)) + 1;
+			PushLockFree(head, link, [userData](Size next) { std::memcpy(userData, &next, sizeof(Size)); });
+		}
+
+		// take the whole remote free list at once and release each block, owner thread only
+		template<typename Release>
+		uint32_t DrainRemote(std::atomic<Size>& head, Release&& release)
+		{
+			auto blockOf = [this](Size link) { return reinterpret_cast<uint8_t*>(GetChunkAbsolute(link - 1)) + userDeltaBytes; };
+			return DrainLockFree(head,
+				[&](Size link) { Size next; std::memcpy(&next, blockOf(link), sizeof(Size)); return next; },
+				[&](Size link) { release(blockOf(link)); });
+		}
+
+		// incremental compaction position, all chunks below it are used, see GarbageCollector::CompactStep
+		Size compactCursor{ 0 };
+
+		// incremental integrity check state, see IntegrityCheckIncremental
+		Size checkCursor{ 0 };       // offset of next chunk to check, always a chunk boundary
+		bool checkSweepClean{ false }; // true if heap unchanged since sweep started
+		uint32_t sweepFreeBlocks{ 0 }, sweepUsedBlocks{ 0 }, sweepFreeMem{ 0 }, sweepUsedMem{ 0 };
+		uint32_t sweepBinChunks[BIN_INDICES]{}; // free chunks seen per bin, compared with each bin's ring at the end
+
 	public:
 		// do integrity checking, see if all items ok
 		bool IntegrityCheck()
 		{
+			EnsureRoot();
 			uint32_t freeCountA = 0, freeMemA = 0;
 			uint32_t usedCountA = 0, usedMemA = 0;
 			uint32_t totalMemUsedA = 0;
@@ -410,7 +1348,10 @@ namespace Lomont::Languages {
 				CheckChunk(s);
 				const auto nextChunk = NextChunk(s);
 				prev = s;
-				assert(s->GetSize() >= sizeof(Size));
+				Assert(s->GetSize() >= sizeof(Size));
+				if constexpr (paranoid)
+					if (IsSelfUsed(s) && !GuardOrParkedIntact(s))
+						throw std::runtime_error("Guard bytes overwritten");
 				if (nextChunk)
 				{
 					if (!nextChunk->IsPrevUsed())
@@ -458,13 +1399,97 @@ namespace Lomont::Languages {
 			{
 				throw std::runtime_error("Bad mem size");
 			}
-			if (this->usedBlocks != usedCountA || this->freeBlocks != freeCountA)
+			if constexpr (statsOn)
 			{
-				throw std::runtime_error("Bad block size");
+				if (this->usedBlocks + quickBlocks != usedCountA || this->freeBlocks != freeCountA)
+				{
+					throw std::runtime_error("Bad block size");
+				}
+				if (this->freeMem != freeMemA || this->usedMem + quickMem != usedMemA)
+				{
+					throw std::runtime_error("Bad mem sizes");
+				}
 			}
-			if (this->freeMem != freeMemA || this->usedMem != usedMemA)
+			return true;
+		}
+
+		/**
+		 * \brief Check a few chunks per call, resuming where the last call stopped.
+		 * Each chunk is checked locally (header, footer, bin links), so the cost is
+		 * O(chunksToCheck) instead of the O(n^2) full IntegrityCheck. When a sweep over
+		 * the whole heap completes with no intervening allocations or frees, the
+		 * totals are compared against the stats, and each bin is walked from its head to
+		 * check it reaches every free chunk of its size class, as well.
+		 * \param chunksToCheck the number of chunks to check this call
+		 * \return true if ok, else throws
+		 */
+		bool IntegrityCheckIncremental(uint32_t chunksToCheck)
+		{
+			EnsureRoot();
+			if (checkCursor >= size())
+				throw std::runtime_error("Bad check cursor");
+			while (chunksToCheck-- > 0)
 			{
-				throw std::runtime_error("Bad mem sizes");
+				Chunk* s = GetChunkAbsolute(checkCursor);
+				const auto chunkSize = s->GetSize();
+				if (chunkSize < sizeof(Size) || chunkSize > size() - checkCursor)
+					throw std::runtime_error("Bad chunk size");
+				CheckChunk(s);
+				if (IsSelfUsed(s))
+				{
+					if constexpr (paranoid)
+						if (!GuardOrParkedIntact(s))
+							throw std::runtime_error("Guard bytes overwritten");
+					sweepUsedBlocks++;
+					sweepUsedMem += chunkSize;
+				}
+				else
+				{
+					if (IsTiny(s))
+					{ // no footer, the next chunk flags it instead
+						const auto next = NextChunk(s);
+						if (next != nullptr && !next->IsPrevTiny())
+							throw std::runtime_error("Free has mismatched sizes");
+					}
+					else
+					{
+						const auto footer = reinterpret_cast<Size*>(reinterpret_cast<uint8_t*>(s) + chunkSize - sizeof(Size));
+						if (*footer != chunkSize)
+							throw std::runtime_error("Free has mismatched sizes");
+					}
+					if (!s->IsPrevUsed() && checkCursor != 0)
+						throw std::runtime_error("Adjacent free chunks");
+					CheckBinLinks(s);
+					sweepBinChunks[FreeChunkBins::GetIndex(chunkSize)]++;
+					sweepFreeBlocks++;
+					sweepFreeMem += chunkSize;
+				}
+
+				const auto next = NextChunk(s);
+				if (next != nullptr)
+				{
+					checkCursor = OffsetOf(next);
+					continue;
+				}
+
+				// end of heap, totals only valid if nothing changed during the sweep
+				if (checkSweepClean)
+				{
+					if constexpr (statsOn)
+					{
+						if (usedBlocks + quickBlocks != sweepUsedBlocks || freeBlocks != sweepFreeBlocks)
+							throw std::runtime_error("Bad block size");
+						if (freeMem != sweepFreeMem || usedMem + quickMem != sweepUsedMem)
+							throw std::runtime_error("Bad mem sizes");
+					}
+					for (auto binIndex = 0; binIndex < BIN_INDICES; ++binIndex)
+						if (CountBin(binIndex) != sweepBinChunks[binIndex])
+							throw std::runtime_error("Free chunk not reachable from its bin");
+				}
+				checkCursor = 0;
+				checkSweepClean = true;
+				sweepFreeBlocks = sweepUsedBlocks = sweepFreeMem = sweepUsedMem = 0;
+				std::fill(std::begin(sweepBinChunks), std::end(sweepBinChunks), 0u);
 			}
 			return true;
 		}
@@ -499,7 +1524,7 @@ namespace Lomont::Languages {
 				);
 				if (!used)
 				{
-					os << std::format(" next {} prev {}", s->nextOffset, s->prevOffset);
+					os << std::format(" next {} prev {}", NextOf(s), PrevOf(s));
 				}
 				os << "\n";
 				s = NextChunk(s);
@@ -509,172 +1534,795 @@ namespace Lomont::Languages {
 #endif
 
 	private:
-		std::vector<uint8_t> memory;
+		// the pool, inside the object for a static pool
+		using Pool = std::conditional_t<staticPool, std::array<uint8_t, Policy::poolBytes>, PagePool>;
+		Pool memory{};
+		bool rootReady{ false }; // heap set up, see EnsureRoot
 		uint8_t* Root() { return memory.data(); }
+
+		// make the whole pool one free chunk
+		void InitRoot()
+		{
+			std::fill_n(chunkBins.bins, BIN_INDICES, InvalidSize);
+			Chunk* root = GetChunkAbsolute(0);
+			WriteHeaderAndFooter(root, size(), false);
+			if constexpr (statsOn)
+			{
+				freeBlocks = 1;
+				freeMem = size();
+			}
+
+			// link into bins
+			AddToFreeList(root);
+			checkSweepClean = true;
+			rootReady = true;
+		}
+	protected:
+		// is this pointer inside the managed memory?
+		[[nodiscard]] bool InPool(const void* p) const
+		{
+			const auto b = static_cast<const uint8_t*>(p);
+			return b >= memory.data() && b < memory.data() + memory.size();
+		}
+
+		// a static pool is constant initialized, so is set up on first use
+		void EnsureRoot()
+		{
+			if constexpr (staticPool)
+				if (!rootReady)
+					InitRoot();
+		}
 	};
 
+	using Allocator = BasicAllocator<>;
+	using SmallAllocator = BasicAllocator<SmallPolicy<>>; // pools under 64K
+
 
-	class GarbageCollector : public Allocator
+	template<typename Policy = AllocatorPolicy<>>
+	class BasicGarbageCollector : public BasicAllocator<Policy>
 	{
+		using Base = BasicAllocator<Policy>;
 	public:
-		using Ref = uint32_t;
+		using Ref = typename Policy::Ref;
+		using PolicyType = Policy;
+		using TypeId = uint16_t; // see RegisterType
+		using typename Base::Size;
+		using Base::InvalidAlloc;
+		using Base::AllocPtr;
+		using Base::FreePtr;
+		using Base::size;
+		using Base::freeBlocks;
+		using Base::freeMem;
+		using Base::FlushQuickLists;
+	protected:
+		using typename Base::Chunk;
+		using Base::statsOn;
+		using Base::Assert;
+		using Base::GetChunkAbsolute;
+		using Base::PlaceChunkRelative;
+		using Base::NextChunk;
+		using Base::IsSelfUsed;
+		using Base::WriteHeaderAndFooter;
+		using Base::AddToFreeList;
+		using Base::RemoveFromFreeList;
+		using Base::checkCursor;
+		using Base::checkSweepClean;
+		using Base::compactCursor;
+		using Base::OffsetOf;
+		using Base::MergeSecondIntoFirst;
+		using Base::TraceBegin;
+		using Base::TraceEnd;
+		using Base::TraceInstant;
+		using Base::InPool;
+		using Base::MinChunkSize;
+		using Base::EnsureRoot;
 	private:
+		static constexpr bool heatOn = Policy::heatScale != 0;
+		static_assert((Policy::heatScale & (Policy::heatScale - 1)) == 0, "heatScale must be a power of 2");
+		static_assert(!heatOn || Policy::hotHeat * Policy::heatScale <= UINT16_MAX, "hotHeat must fit the 16 bit access count");
+		struct NoHeat {};
+		static constexpr bool typesOn = Policy::maxTypes != 0;
+		static_assert(Policy::maxTypes < 0xFFFF, "Type ids are 16 bits");
+		struct NoType {};
+		static constexpr bool profileOn = Policy::profileSampleBytes != 0;
+		static_assert(Policy::profileSampleBytes <= (1u << 30), "profileSampleBytes too large");
+		struct NoSample {};
+		static constexpr bool ownersOn = Policy::blockOwners;
+		static constexpr Size OwnerBytes = ownersOn ? sizeof(Ref) : 0; // see OwnerOf
+
 		// not fast, but let's do like this for now
 		// todo - allocate inside requested memory
-#pragma pack(push,1)
+		// pointer first and not packed, so entries are padded to a multiple of pointer alignment
+		// and every entry's pointer is aligned, whichever optional fields follow
 		struct RefHolder
 		{
-			Size refCount{ 0 };
-			Size size{ 0 }; // size that was requested
 			void* pointer{ nullptr };
+			Ref refCount{ 0 }; // with HotBit and LargeBit, or when free, the next free Ref plus 1, see freeRefs
+			Size size{ 0 }; // size that was requested
+			[[no_unique_address]] mutable std::conditional_t<heatOn, uint16_t, NoHeat> heat{}; // PointerFromRef calls, halved by Compact
+			[[no_unique_address]] std::conditional_t<typesOn, TypeId, NoType> type{}; // see RegisterType
+			[[no_unique_address]] std::conditional_t<profileOn, uint32_t, NoSample> sample{}; // index in samples plus 1, 0 if not sampled
 		};
-#pragma pack(pop)
+		static_assert(alignof(RefHolder) == alignof(void*) && sizeof(RefHolder) % alignof(void*) == 0, "RefHolder pointers must stay aligned");
+		// top bits of a live refCount mark Placement::Hot and the large object space, so entries need no extra field
+		static constexpr Ref HotBit = static_cast<Ref>(~(static_cast<Ref>(-1) >> 1));
+		static constexpr Ref LargeBit = HotBit >> 1;
+		static constexpr Ref CountMask = static_cast<Ref>(~(HotBit | LargeBit));
+		static_assert(heatOn || typesOn || profileOn ||
+			sizeof(RefHolder) == (sizeof(void*) + sizeof(Ref) + sizeof(Size) + alignof(void*) - 1) / alignof(void*) * alignof(void*), "RefHolder grew");
 
 	public:
 		/**
 		 * \brief Create a garbage collector
 		 * \param bytesUsed the bytes to manage
 		 */
-		GarbageCollector(uint32_t bytesUsed) : Allocator(bytesUsed)
+		BasicGarbageCollector(uint32_t bytesUsed) requires (!Base::staticPool) : Base(bytesUsed)
+		{
+		}
+
+		/**
+		 * \brief Create a garbage collector with its pool and ref table inside the object, see
+		 * StaticPolicy. Constant initialized, never allocates.
+		 */
+		constexpr BasicGarbageCollector() requires Base::staticPool = default;
+
+		constexpr static Ref InvalidRef{static_cast<Ref>(-1)};
+
+		// stats, only updated when Policy::stats is Stats::On
+		uint32_t collections{ 0 }, swaps{ 0 }, bytesMoved{ 0 };
+		uint32_t largeObjects{ 0 }, largeBytes{ 0 }; // live objects in the large object space
+
+		/**
+		 * \brief Place allocations of at least this many bytes in the large object space
+		 * instead of the pool. Each gets its own page aligned pages from the OS, is never moved
+		 * by compaction, and is returned to the OS when freed. Off by default.
+		 * \param bytes the threshold, or InvalidSize to turn off
+		 */
+		void SetLargeObjectThreshold(Size bytes) { largeObjectThreshold = bytes == Base::InvalidSize ? 0 : bytes; }
+		[[nodiscard]] Size LargeObjectThreshold() const { return largeObjectThreshold == 0 ? Base::InvalidSize : largeObjectThreshold; }
+
+		// true if the Ref lives in the large object space
+		[[nodiscard]] bool IsLargeRef(const Ref& ref) const { return (refs[ref].refCount & LargeBit) != 0; }
+
+		/**
+		 * \brief Allocate a block and return a Ref. 
+		 * \param requestedByteSize the size to allocate in bytes
+		 * \param placement Placement::Hot for often used blocks, which Compact gathers at the bottom of the heap
+		 * \return a ref with an initial reference count of 1
+		 */
+		Ref AllocRef(uint32_t requestedByteSize, Placement placement = Placement::Cold)
+		{
+			if (remoteRefFrees.load(std::memory_order_relaxed) != 0)
+				DrainRemoteFrees();
+
+			if (requestedByteSize >= Base::InvalidSize)
+				return InvalidRef; // cannot be held in a Size
+			if (largeObjectThreshold != 0 && requestedByteSize >= largeObjectThreshold)
+				return AllocLargeRef(requestedByteSize);
+			if (requestedByteSize >= Base::InvalidSize - OwnerBytes)
+				return InvalidRef; // no room for the owner Ref
+
+			const auto ptr = Base::AllocBlock(static_cast<Size>(requestedByteSize), OwnerBytes, placement);
+			if (ptr == InvalidAlloc)
+				return InvalidRef;
+			const Ref ref = GetFreeRef(ptr, requestedByteSize);
+			if (ref == InvalidRef)
+			{
+				FreePtr(ptr);
+				return ref;
+			}
+			if constexpr (ownersOn)
+				SetOwner(ptr, ref);
+			if (placement == Placement::Hot)
+				refs[ref].refCount |= HotBit;
+			return ref;
+
+		}
+
+		/**
+		 * \brief Allocate a block of a registered type and return a Ref, with Policy::maxTypes nonzero
+		 * \param requestedByteSize the size to allocate in bytes
+		 * \param type an id from RegisterType, or 0 for untyped
+		 * \param placement see AllocRef
+		 * \return a ref with an initial reference count of 1, or InvalidRef
+		 */
+		Ref AllocRef(uint32_t requestedByteSize, TypeId type, Placement placement = Placement::Cold) requires typesOn
+		{
+			if (type > typeCount)
+				throw std::runtime_error("Unknown type");
+			const auto ref = AllocRef(requestedByteSize, placement);
+			if (ref != InvalidRef && type != 0)
+			{
+				CountType(refs[ref], -1);
+				refs[ref].type = type;
+				CountType(refs[ref], 1);
+			}
+			return ref;
+		}
+
+		/**
+		 * \brief Free a ref, no matter the reference count
+		 * \param ref the reference to free
+		 */
+		void FreeRef(const Ref& ref)
+		{
+			CheckLive(ref);
+			Release(ref);
+		}
+
+		/**
+		 * \brief Free a ref, no matter the reference count, from a thread that does not own
+		 * this collector. Lock free. The block is queued through its own memory, and freed by
+		 * the owning thread in a batch on its next AllocRef, Compact, or DrainRemoteFrees.
+		 * With a ref table that moves as it grows, such as std::vector, the table must not grow
+		 * while this runs, see ReserveRefs. The owner must not be compacting. Throws for a large
+		 * object, or a tiny chunk, which have no pool block to queue; free those on the owner.
+		 * \param ref the reference to free
+		 */
+		void RemoteFreeRef(const Ref& ref)
+		{
+			const auto& rh = SharedRef(ref);
+			if (!InPool(rh.pointer))
+				throw std::runtime_error("Remote free of a large or freed ref");
+			if (Base::tinyChunks && rh.size <= sizeof(Size)) // no room for link and ref
+				throw std::runtime_error("Remote free of a tiny chunk");
+			const auto userData = static_cast<uint8_t*>(rh.pointer);
+			std::memcpy(userData + sizeof(Size), &ref, sizeof(Ref)); // link goes in first Size bytes
+			Base::PushRemote(remoteRefFrees, userData);
+		}
+
+		/**
+		 * \brief Free all blocks queued by RemoteFreeRef and RemoteFreePtr. Only call from the owning thread.
+		 * \return the number of blocks freed
+		 */
+		uint32_t DrainRemoteFrees()
+		{
+			return Base::DrainRemoteFrees() +
+				Base::DrainRemote(remoteRefFrees, [this](uint8_t* userData)
+					{
+						Ref ref;
+						std::memcpy(&ref, userData + sizeof(Size), sizeof(Ref));
+						Assert(refs[ref].pointer == userData);
+						Release(ref);
+					});
+		}
+
+		/**
+		 * \brief Make room for count refs up front. A ref table that moves as it grows, such as
+		 * std::vector, then does not move until more are used
+		 * \param count the number of refs to reserve
+		 */
+		void ReserveRefs(uint32_t count) { refs.reserve(count); }
+
+		// number of ref table entries, live or free, which sets the table's memory and CompactInOrder's ref passes
+		[[nodiscard]] uint32_t RefTableSize() const { return static_cast<uint32_t>(refs.size()); }
+
+		/**
+		 * \brief Drop the free entries after the last live Ref, and release the memory the ref
+		 * table and Compact's scratch table hold beyond that. Moves the table, so other threads
+		 * must not be reading it, see ReadRef.
+		 * \return the number of entries dropped
+		 */
+		uint32_t ShrinkRefs()
+		{
+			BeginMoves();
+			const auto dropped = TrimFreeRefs();
+			refs.shrink_to_fit();
+			backing.clear();
+			backing.shrink_to_fit();
+			EndMoves();
+			return dropped;
+		}
+
+		/**
+		 * \brief Renumber live Refs to 0 through live count - 1, keeping their order, then
+		 * ShrinkRefs, so the table is sized to the live objects instead of the historic peak.
+		 * Blocks do not move. Queued remote frees are done first.
+		 * \param remap called as remap(oldRef, newRef) for each Ref that changes, which must
+		 *        replace every copy of oldRef the host holds, including inside blocks
+		 * \return the number of Refs renumbered
+		 */
+		template<typename Remap>
+		uint32_t CompactRefs(Remap&& remap)
+		{
+			DrainRemoteFrees(); // queued blocks hold old Refs
+			BeginMoves();
+			uint32_t live = 0, renumbered = 0;
+			for (auto i = 0u; i < refs.size(); ++i)
+			{
+				if (refs[i].pointer == nullptr)
+					continue;
+				if (i != live)
+				{
+					refs[live] = refs[i];
+					refs[i] = RefHolder{};
+					if (ownersOn && (refs[live].refCount & LargeBit) == 0)
+						SetOwner(refs[live].pointer, static_cast<Ref>(live));
+					if constexpr (profileOn)
+						if (refs[live].sample != 0)
+							samples[refs[live].sample - 1].ref = live;
+					if (regionDepth != 0 && regionRef == i)
+						regionRef = live;
+					else
+						remap(static_cast<Ref>(i), static_cast<Ref>(live));
+					++renumbered;
+				}
+				++live;
+			}
+			EndMoves();
+			ShrinkRefs();
+			return renumbered;
+		}
+
+		/**
+		 * \brief Free every Ref at once, no matter the reference counts. The pool becomes one free
+		 * chunk and the ref table empties, keeping its capacity, so the cost does not depend on
+		 * how many refs were live, except that large objects, if any, are returned one by one.
+		 * All Refs and pointers are invalid afterwards. Blocks queued by RemoteFreeRef are
+		 * dropped, so no other thread may be freeing during the call.
+		 */
+		void Reset()
+		{
+			BeginMoves();
+			if (largeLive != 0)
+				for (const auto& rh : refs)
+					if (rh.pointer != nullptr && (rh.refCount & LargeBit) != 0)
+						FreeLarge(rh.pointer, rh.size);
+			remoteRefFrees.store(0, std::memory_order_relaxed);
+			Base::Reset();
+			refs.clear();
+			freeRefs = 0;
+			if constexpr (typesOn)
+				for (auto& info : types)
+					info.liveObjects = info.liveBytes = 0;
+			if constexpr (profileOn)
+			{
+				samples.clear();
+				for (auto& site : sites)
+					site.liveObjects = site.liveBytes = 0;
+			}
+			regionRef = regionBytes = regionUsed = 0;
+			regionDepth = 0;
+			EndMoves();
+		}
+
+		// where to return to, see PushRegion
+		struct RegionMark
+		{
+			uint32_t depth; // regions open after the push, 0 if the push failed
+			Size used;      // region bytes used before the push
+		};
+
+		/**
+		 * \brief Open a region. RegionAlloc bumps allocations from one slice of the pool, and
+		 * PopRegion releases everything allocated since the matching push at once. The outermost
+		 * region reserves the slice, nested regions share it, stack fashion. The slice is an
+		 * ordinary block, so compaction may move it: region pointers are valid until the next
+		 * compaction, as with PointerFromRef. See PromoteRegionAlloc to keep an object.
+		 * \param reserveBytes the slice size, used by the outermost region only
+		 * \return mark to pass to PopRegion, with depth 0 if the slice could not be reserved
+		 */
+		RegionMark PushRegion(Size reserveBytes = 0)
+		{
+			if (regionDepth == 0)
+			{
+				if (reserveBytes == 0)
+					throw std::runtime_error("Outermost region needs a size");
+				const auto ref = AllocRef(reserveBytes);
+				if (ref == InvalidRef)
+					return { 0, 0 };
+				regionRef = ref;
+				regionBytes = reserveBytes;
+				regionUsed = 0;
+			}
+			return { ++regionDepth, regionUsed };
+		}
+
+		/**
+		 * \brief Close the innermost region, releasing all its allocations. Closing the outermost
+		 * region returns the slice to the pool.
+		 * \param mark the value returned by the matching PushRegion
+		 */
+		void PopRegion(const RegionMark& mark)
+		{
+			if (mark.depth == 0)
+				return; // push failed
+			if (mark.depth != regionDepth)
+				throw std::runtime_error("Regions popped out of order");
+			regionUsed = mark.used;
+			if (--regionDepth == 0)
+			{
+				Release(regionRef);
+				regionBytes = 0;
+			}
+		}
+
+		/**
+		 * \brief Allocate from the innermost region, by bumping a cursor
+		 * \param requestedByteSize the size to allocate in bytes
+		 * \return a pointer to the memory, valid until the region is popped or the heap compacts,
+		 *         or nullptr if no region is open or the slice is full
+		 */
+		void* RegionAlloc(Size requestedByteSize)
+		{
+			const auto bytes = Base::RoundUp(requestedByteSize); // keep blocks aligned as pool blocks are
+			if (regionDepth == 0 || bytes < requestedByteSize || bytes > regionBytes - regionUsed)
+				return InvalidAlloc;
+			const auto ptr = static_cast<uint8_t*>(refs[regionRef].pointer) + regionUsed;
+			regionUsed += bytes;
+			return ptr;
+		}
+
+		/**
+		 * \brief Copy a region allocation that must outlive its region into a new block
+		 * \param ptr the region allocation
+		 * \param byteSize the bytes to copy
+		 * \param placement see AllocRef
+		 * \return a ref with an initial reference count of 1, or InvalidRef
+		 */
+		Ref PromoteRegionAlloc(const void* ptr, Size byteSize, Placement placement = Placement::Cold)
+		{
+			const auto ref = AllocRef(byteSize, placement);
+			if (ref != InvalidRef)
+				std::memcpy(refs[ref].pointer, ptr, byteSize);
+			return ref;
+		}
+
+		/**
+		 * \brief Increment a reference count. Throws at the count limit, CountMask, so the
+		 * count never carries into the hot and large flags above it
+		 * \param ref the Ref to increment
+		 */
+		void IncrRef(const Ref& ref)
+		{
+			auto& rh = refs[ref];
+			if ((rh.refCount & CountMask) == CountMask)
+				throw std::overflow_error("Reference count overflow");
+			rh.refCount++;
+		}
+
+		/**
+		 * \brief Decrement a reference count. When zero, memory is released
+		 * \param ref the Ref to increment
+		 * \return true if the reference is still alive
+		 */
+		bool DecrRef(const Ref& ref)
+		{
+			CheckLive(ref);
+			auto& rh = refs[ref];
+			if ((rh.refCount & CountMask) > 1)
+			{
+				rh.refCount--;
+				return true;
+			}
+			Release(ref);
+			return false;
+		}
+
+		// get size of the memory from a Ref
+		[[nodiscard]] uint32_t SizeFromRef(const Ref& ref) const { return refs[ref].size; }
+		// get the pointer to underlying memory from a Ref
+		[[nodiscard]] void* PointerFromRef(const Ref& ref) const
+		{
+			if constexpr (heatOn)
+				CountHeat(ref);
+			return refs[ref].pointer;
+		}
+		// get the current rec count from a Ref
+		[[nodiscard]] uint32_t RefCount(const Ref& ref) const { return refs[ref].refCount & CountMask; }
+
+		/* Type registry, with Policy::maxTypes nonzero. Each ref holds a 16 bit TypeId into a
+		 * fixed table, id 0 being untyped, so typing costs a 2 byte field, before padding, and no pointers.
+		 */
+		// called with the object's data and requested size, calls visit(context, child) for each Ref it holds
+		using TraceFn = void (*)(const void* object, uint32_t byteSize, void (*visit)(void* context, Ref child), void* context);
+		// called with the object's data and requested size just before its memory is released
+		using FinalizeFn = void (*)(void* object, uint32_t byteSize);
+
+		struct TypeInfo
+		{
+			const char* name;     // must outlive the collector, such as a string literal
+			TraceFn trace;        // may be nullptr
+			FinalizeFn finalize;  // may be nullptr
+			uint32_t liveObjects; // only updated when Policy::stats is Stats::On
+			uint32_t liveBytes;   // requested bytes, as SizeFromRef
+		};
+
+		/**
+		 * \brief Register a type for AllocRef(size, type)
+		 * \param name type name for statistics, must outlive the collector
+		 * \param trace lists the Refs an object holds, see TraceRef, or nullptr
+		 * \param finalize run when an object is freed, or nullptr. It may free other refs, as
+		 *        when releasing children. Reset runs no finalizers
+		 * \return the new type id, starting at 1
+		 */
+		TypeId RegisterType(const char* name, TraceFn trace = nullptr, FinalizeFn finalize = nullptr) requires typesOn
+		{
+			if (typeCount == Policy::maxTypes)
+				throw std::runtime_error("Type registry full");
+			types[++typeCount] = TypeInfo{ name, trace, finalize, 0, 0 };
+			return typeCount;
+		}
+
+		// type id of a Ref, 0 if untyped
+		[[nodiscard]] TypeId TypeOf(const Ref& ref) const requires typesOn { return refs[ref].type; }
+
+		// registered types, ids 1 through TypeCount()
+		[[nodiscard]] uint32_t TypeCount() const requires typesOn { return typeCount; }
+
+		// a type's callbacks and live object stats, id 0 counts untyped refs
+		[[nodiscard]] const TypeInfo& TypeStats(TypeId type) const requires typesOn { return types[type]; }
+
+		/**
+		 * \brief Call visit(child) for each Ref the object holds, using its type's trace function
+		 * \param ref the object
+		 * \param visit called with each child Ref
+		 */
+		template<typename Visitor>
+		void TraceRef(const Ref& ref, Visitor&& visit) requires typesOn
+		{
+			const auto& rh = refs[ref];
+			if (const auto trace = types[rh.type].trace)
+				trace(rh.pointer, rh.size,
+					[](void* context, Ref child) { (*static_cast<std::remove_reference_t<Visitor>*>(context))(child); },
+					&visit);
+		}
+
+		/* Sampling heap profiler, with Policy::profileSampleBytes nonzero. About one AllocRef per
+		 * profileSampleBytes bytes allocated is sampled, at random, and charged to the current
+		 * allocation site. Each sample stands for the allocations it represents, so per site
+		 * totals are estimates. Live totals drop as sampled refs are freed. See WriteHeapProfile.
+		 */
+		static constexpr uint32_t ProfileSampleBytes = Policy::profileSampleBytes;
+
+		// estimated totals for one allocation site
+		struct SiteStats
+		{
+			uint32_t site;
+			double liveObjects, liveBytes;   // not yet freed
+			double allocObjects, allocBytes; // since creation
+		};
+
+		/**
+		 * \brief Set the site charged for following AllocRefs, such as a script's bytecode
+		 * offset or a hash of a backtrace
+		 * \param site the host's id for the allocation site
+		 */
+		void SetAllocSite(uint32_t site) requires profileOn { allocSite = site; }
+
+		// per site estimates, in site order
+		[[nodiscard]] const std::vector<SiteStats>& Sites() const requires profileOn { return sites; }
+
+		/**
+		 * \brief Access heat of a Ref, with Policy::heatScale nonzero. Each PointerFromRef call adds one to
+		 * a 16 bit count for the Ref it was for, saturating, and heat is that count / heatScale. Each Compact
+		 * halves the count, and blocks with heat of at least Policy::hotHeat are gathered with Placement::Hot
+		 * blocks. Counts are relaxed atomics, so any thread may call PointerFromRef, though calls racing on
+		 * one Ref can lose counts.
+		 * \param ref the Ref to look up
+		 * \return the heat, 0 if counting is off
+		 */
+		[[nodiscard]] uint32_t Heat(const Ref& ref) const
 		{
-			refs.resize(100); // max for now?
+			if constexpr (heatOn)
+				return HeatOf(ref).load(std::memory_order_relaxed) / Policy::heatScale;
+			else
+				return 0;
 		}
 
-		constexpr static Ref InvalidRef{static_cast<Ref>(-1)};
+		/* Lock free reads from other threads while the owning thread allocates and compacts.
+		 * A sequence number is odd while blocks or refs are moving. Readers note the
+		 * sequence, read, then check it is unchanged, retrying if not. Reads may see torn data
+		 * while a move is in progress, which the check discards, so only copy data out inside
+		 * a read, and act on it after it validates.
+		 *
+		 *    int value;
+		 *    gc.CopyFromRef(ref, &value, 0, sizeof(value));
+		 *
+		 * Readers index the ref table while AllocRef may grow it, so the table must never move
+		 * entries or free memory as it grows, as PagedVector and FixedVector do. ShrinkRefs,
+		 * CompactRefs, and Reset must not overlap reads. PointerFromRef is for the owning thread,
+		 * or any thread while the table cannot grow; inside a read, reach other refs with a
+		 * nested ReadRef. Heat counts are atomic. The Ref itself must stay alive during the read.
+		 */
+		static constexpr bool stableRefs = requires { requires Policy::template RefTable<RefHolder>::stableGrowth; };
 
-		// stats
-		uint32_t collections{ 0 }, swaps{ 0 }, bytesMoved{ 0 };
+		// begin a lock free read, waits out any move in progress, returns sequence for ReadValidate
+		[[nodiscard]] uint32_t ReadBegin() const
+		{
+			static_assert(stableRefs, "Lock free reads need a ref table that never moves as it grows, such as PagedVector");
+			uint32_t seq;
+			while (((seq = moveSequence.load(std::memory_order_acquire)) & 1) != 0)
+				; // spin, moves are short
+			return seq;
+		}
+
+		// true if nothing moved since ReadBegin returned seq, so data read since then is good
+		[[nodiscard]] bool ReadValidate(uint32_t seq) const
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return moveSequence.load(std::memory_order_relaxed) == seq;
+		}
 
 		/**
-		 * \brief Allocate a block and return a Ref. 
-		 * \param requestedByteSize the size to allocate in bytes
-		 * \return a ref with an initial reference count of 1
+		 * \brief Lock free read of a Ref's block, retrying until no compaction interferes
+		 * \param ref the Ref to read
+		 * \param reader called with the block's const void* pointer, may be called more than once
+		 * \return whatever reader returns, from a validated call
 		 */
-		Ref AllocRef(uint32_t requestedByteSize)
+		template<typename Reader>
+		auto ReadRef(const Ref& ref, Reader&& reader) const
 		{
-			const auto ptr = AllocPtr(requestedByteSize);
-			if (ptr == InvalidAlloc)
-				return InvalidRef;
-			const Ref ref = GetFreeRef(ptr, requestedByteSize);
-			if (ref == InvalidRef)
+			while (true)
 			{
-				FreePtr(ptr);
-				return ref;
+				const auto seq = ReadBegin();
+				auto result = reader(static_cast<const void*>(SharedRef(ref).pointer));
+				if (ReadValidate(seq))
+					return result;
 			}
-			return ref;
-
 		}
 
 		/**
-		 * \brief Free a ref, no matter the reference count
-		 * \param ref the reference to free
+		 * \brief Lock free copy out of a Ref's block, consistent during concurrent compaction
+		 * \param ref the Ref to read
+		 * \param dst where to copy to
+		 * \param offset byte offset into the block
+		 * \param bytes number of bytes to copy
 		 */
-		void FreeRef(const Ref& ref)
+		void CopyFromRef(const Ref& ref, void* dst, uint32_t offset, uint32_t bytes) const
 		{
-			auto& rh = refs[ref];
-			FreePtr(rh.pointer);
-			rh.pointer = nullptr;
-			rh.size = 0;
-			rh.refCount = InvalidRef;
+			ReadRef(ref, [&](const void* src)
+				{
+					std::memcpy(dst, static_cast<const uint8_t*>(src) + offset, bytes);
+					return true;
+				});
 		}
 
-		/**
-		 * \brief Increment a reference count
-		 * \param ref the Ref to increment
-		 */
-		void IncrRef(const Ref& ref) { refs[ref].refCount++; /* todo - overflow ? */ }
+		using typename Base::ChunkInfo;
 
 		/**
-		 * \brief Decrement a reference count. When zero, memory is released
-		 * \param ref the Ref to increment
-		 * \return true if the reference is still alive
+		 * \brief Visit each chunk in address order, with the owning Ref filled in for used chunks
+		 * \param visit called with a const ChunkInfo& for each chunk
 		 */
-		bool DecrRef(const Ref& ref)
+		template<typename Visitor>
+		void ForEachChunk(Visitor&& visit)
 		{
-			auto& rh = refs[ref];
-			if (rh.refCount > 1)
+			if constexpr (ownersOn)
 			{
-				rh.refCount--;
-				return true;
+				Base::ForEachChunk([&](const ChunkInfo& chunk)
+					{
+						ChunkInfo info = chunk;
+						if (info.used)
+						{ // blocks from AllocPtr have no owner Ref, so check it points back at the block
+							const auto cur = GetChunkAbsolute(info.offset);
+							const auto ref = OwnerOf(cur);
+							if (ref < refs.size() && refs[ref].pointer == reinterpret_cast<uint8_t*>(cur) + Base::userDeltaBytes)
+								info.owner = ref;
+						}
+						visit(info);
+					});
+				return;
 			}
-			FreeRef(ref);
-			return false;
-		}
 
-		// get size of the memory from a Ref
-		[[nodiscard]] uint32_t SizeFromRef(const Ref& ref) const { return refs[ref].size; }
-		// get the pointer to underlying memory from a Ref
-		[[nodiscard]] void* PointerFromRef(const Ref& ref) const { return refs[ref].pointer; }
-		// get the current rec count from a Ref
-		[[nodiscard]] uint32_t RefCount(const Ref& ref) const { return refs[ref].refCount; }
+			// chunk offset to Ref, in address order
+			std::vector<std::pair<Size, Ref>> owners;
+			for (auto i = 0u; i < refs.size(); ++i)
+				if (refs[i].pointer != nullptr && InPool(refs[i].pointer))
+					owners.emplace_back(static_cast<Size>(static_cast<uint8_t*>(refs[i].pointer) - Base::userDeltaBytes - reinterpret_cast<uint8_t*>(GetChunkAbsolute(0))), i);
+			std::sort(owners.begin(), owners.end());
+
+			auto owner = owners.begin();
+			Base::ForEachChunk([&](const ChunkInfo& chunk)
+				{
+					ChunkInfo info = chunk;
+					while (owner != owners.end() && owner->first < info.offset)
+						++owner;
+					if (info.used && owner != owners.end() && owner->first == info.offset)
+						info.owner = owner->second;
+					visit(info);
+				});
+		}
 
 		/**
 		 * \brief Perform a memory compaction, which moves all free memory blocks together,
-		 * reclaiming fragmented memory.
+		 * reclaiming fragmented memory. Blocks allocated with Placement::Hot are gathered
+		 * below the others, keeping address order within each group.
 		 */
 		void Compact()
 		{
 			// todo; - how to make work with other interspersed items? cannot? do not?
 
-			std::vector<uint32_t> backing(refs.size());
-			uint32_t* p;
-			// 1. walk refs, put ref into each used block (save overwritten info, restore at end)
-			for (auto i = 0u; i < refs.size(); ++i)
+			TraceBegin(TraceEvent::Compact);
+			EnsureRoot();
+			DrainRemoteFrees(); // queued blocks are linked by offset, cannot move
+			FlushQuickLists(); // parked chunks have no ref
+			if constexpr (!ownersOn)
+				backing.resize(refs.size());
+			BeginMoves();
+			// 1. walk refs, put ref into each used block (save overwritten info, restore at end),
+			// or with owner Refs, each used block already ends with its Ref, see OwnerOf
+			TraceBegin(TraceEvent::CompactMarkRefs);
+			uint32_t hotCount = 0, usedCount = 0;
+			if constexpr (ownersOn)
+			{
+				for (auto cur = GetChunkAbsolute(0); cur != nullptr; cur = NextChunk(cur))
+					if (IsSelfUsed(cur) && IsHotChunk(cur))
+						++hotCount;
+			}
+			else
 			{
-				if (refs[i].pointer != nullptr)
+				for (auto i = 0u; i < refs.size(); ++i)
 				{
-					// TODO?: Need to ensure mem-alloc has at least this much slack space - does currently
+					if (refs[i].pointer != nullptr && (refs[i].refCount & LargeBit) == 0) // large objects never move
+					{
+						if (IsHotRef(i)) ++hotCount;
 
-					// store data
-					p = static_cast<uint32_t*>(refs[i].pointer);
-					backing[i] = *p;
-					*p = i;
+						// store data
+						const auto p = static_cast<Ref*>(refs[i].pointer);
+						backing[i] = *p;
+						*p = static_cast<Ref>(i);
+					}
 				}
 			}
+			TraceEnd(TraceEvent::CompactMarkRefs, 0);
 
 			// 2. unlink all free nodes from tracking bins. We will destroy all free
+			TraceBegin(TraceEvent::CompactUnlinkFree);
 			auto cur = GetChunkAbsolute(0); // start here
 
 			do { // move used to lowest addresses
 				if (!IsSelfUsed(cur))
 
 				{
-					freeBlocks--;
+					if constexpr (statsOn) freeBlocks--;
 					RemoveFromFreeList(cur);
 				}
 				cur = NextChunk(cur);
 			} while (cur != nullptr);
+			TraceEnd(TraceEvent::CompactUnlinkFree, 0);
 
 			// 3. walk nodes in Next order. Any used, move to lower addresses
+			TraceBegin(TraceEvent::CompactSlide);
 			cur = GetChunkAbsolute(0);
 			auto nextWrite = reinterpret_cast<uint8_t*>(cur); // top of stack
-			uint32_t usedSize = 0;
+			uint32_t usedSize = 0, slideBytes = 0;
 			do { // move used to lowest addresses
 				const auto nxt = NextChunk(cur);
 				if (IsSelfUsed(cur))
 				{
 					const auto size = cur->GetSize();
 					usedSize += size;
+					++usedCount;
 					if (cur != static_cast<void*>(nextWrite))
+					{
 						memmove(nextWrite, cur, size);
+						slideBytes += size;
+					}
 					WriteHeaderAndFooter(reinterpret_cast<Chunk*>(nextWrite), size, true);
 					nextWrite += size;
 
-					bytesMoved += size;
-					swaps++;
+					if constexpr (statsOn)
+					{
+						bytesMoved += size;
+						swaps++;
+					}
 
 				}
 				cur = nxt;
 			} while (cur != nullptr);
+			if (hotCount != 0 && hotCount != usedCount)
+				PartitionHot(reinterpret_cast<uint8_t*>(GetChunkAbsolute(0)), nextWrite, usedCount, slideBytes);
+			TraceEnd(TraceEvent::CompactSlide, slideBytes);
 
 			// 4. one (possible) final free node, add to bins
+			TraceBegin(TraceEvent::CompactFreeChunk);
 			const Size freeSize = size() - usedSize;
 			Chunk* freeChunk = nullptr;
-			freeMem = freeSize;
+			if constexpr (statsOn) freeMem = freeSize;
 			if (freeSize > 0)
 			{
-				freeBlocks++;
-				assert(freeSize >= sizeof(Chunk) + sizeof(Size)); // min free size?
+				if constexpr (statsOn) freeBlocks++;
+				Assert(freeSize >= MinChunkSize);
 				freeChunk = reinterpret_cast<Chunk*>(nextWrite);
 				WriteHeaderAndFooter(freeChunk, freeSize, false);
 				freeChunk->SetPrevUsed(true);
@@ -683,35 +2331,470 @@ namespace Lomont::Languages {
 
 			// mark all used
 			cur = GetChunkAbsolute(0); // start here
-			do { // move used to lowest addresses
+			while (cur != freeChunk && cur != nullptr)
+			{
 				cur->SetPrevUsed(true);
 				cur = NextChunk(cur);
-			} while (cur != freeChunk);
-
+			}
+			TraceEnd(TraceEvent::CompactFreeChunk, freeSize);
 
-			// 5. walk refs, for each used, look up ref, update ref, restore used info
+			// 5. walk used blocks, point each one's ref at it, restore used info
+			TraceBegin(TraceEvent::CompactFixRefs);
 			cur = GetChunkAbsolute(0); // start here
-			do { // move used to lowest addresses
-				if (IsSelfUsed(cur))
-				{
-					p = reinterpret_cast<uint32_t*>(cur);
-					p++; // skip front of Chunk data
-					const auto index = *p;
+			while (cur != freeChunk && cur != nullptr)
+			{ // all chunks before freeChunk are used
+				const auto index = OwnerOf(cur);
+				const auto p = reinterpret_cast<Ref*>(reinterpret_cast<uint8_t*>(cur) + Base::userDeltaBytes); // skip front of Chunk data
+				if constexpr (!ownersOn)
 					*p = backing[index];
-					refs[index].pointer = p;
+				refs[index].pointer = p;
+				if constexpr (heatOn)
+				{ // favor recent accesses
+					const auto heat = HeatOf(index);
+					heat.store(heat.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
 				}
 				cur = NextChunk(cur);
-			} while (cur != freeChunk);
+			}
+			TraceEnd(TraceEvent::CompactFixRefs, 0);
+
+			checkCursor = 0; // old chunk boundaries are gone
+			compactCursor = 0;
+			checkSweepClean = false;
+			if constexpr (statsOn) collections++;
+			EndMoves();
+			TraceEnd(TraceEvent::Compact, slideBytes);
+		}
+
+		/**
+		 * \brief Compact, placing blocks in a given order instead of address order, so objects
+		 * used together end up adjacent. Blocks not visited follow in address order. Copies
+		 * live blocks through a temporary buffer the size of the live data, allocated before the
+		 * heap changes, so a failed allocation leaves the heap as it was. The buffer is why a
+		 * static collector, which must not allocate, cannot use it.
+		 * \param enumerate called once with a callable place(ref), which it calls for refs in
+		 *        the desired order, such as depth first from roots, or by ref index. Repeats,
+		 *        InvalidRef, and large objects are ignored. It must not allocate or free.
+		 */
+		template<typename Enumerate>
+		void CompactInOrder(Enumerate&& enumerate) requires (!Base::staticPool)
+		{
+			TraceBegin(TraceEvent::Compact);
+			EnsureRoot();
+			DrainRemoteFrees();
+			FlushQuickLists();
+
+			// 1. placement order, visited first
+			backing.resize(refs.size()); // 1 once placed
+			std::fill(backing.begin(), backing.end(), Ref{ 0 });
+			std::vector<Ref> order;
+			enumerate([&](Ref ref)
+				{
+					if (ref < refs.size() && refs[ref].pointer != nullptr && InPool(refs[ref].pointer) && backing[ref] == 0)
+					{
+						backing[ref] = 1;
+						order.push_back(ref);
+					}
+				});
+			const auto visited = order.size();
+			for (auto i = 0u; i < refs.size(); ++i)
+				if (refs[i].pointer != nullptr && InPool(refs[i].pointer) && backing[i] == 0)
+					order.push_back(static_cast<Ref>(i));
+			std::sort(order.begin() + visited, order.end(), [this](Ref a, Ref b) { return refs[a].pointer < refs[b].pointer; });
+			auto chunkOf = [](void* pointer) { return reinterpret_cast<Chunk*>(static_cast<uint8_t*>(pointer) - Base::userDeltaBytes); };
+			Size usedSize = 0;
+			for (const auto ref : order)
+				usedSize += chunkOf(refs[ref].pointer)->GetSize();
+			if (usedSize == 0)
+			{ // no blocks, so the pool is one free chunk already
+				TraceEnd(TraceEvent::Compact, 0);
+				return;
+			}
+
+			// 2. copy used chunks out in order, then unlink free chunks
+			std::vector<uint8_t> scratch(usedSize);
+			Size offset = 0;
+			for (const auto ref : order)
+			{
+				const auto chunk = chunkOf(refs[ref].pointer);
+				std::memcpy(scratch.data() + offset, chunk, chunk->GetSize());
+				offset += chunk->GetSize();
+			}
+			for (auto cur = GetChunkAbsolute(0); cur != nullptr; cur = NextChunk(cur))
+				if (!IsSelfUsed(cur))
+					RemoveFromFreeList(cur);
+
+			// 3. copy back packed at the bottom, rebuild headers and refs
+			BeginMoves();
+			const auto base = reinterpret_cast<uint8_t*>(GetChunkAbsolute(0));
+			std::memcpy(base, scratch.data(), usedSize);
+			offset = 0;
+			for (const auto ref : order)
+			{
+				const auto chunk = reinterpret_cast<Chunk*>(base + offset);
+				const auto size = chunk->GetSize();
+				WriteHeaderAndFooter(chunk, size, true);
+				chunk->SetPrevUsed(true);
+				refs[ref].pointer = base + offset + Base::userDeltaBytes;
+				offset += size;
+			}
+			EndMoves();
+
+			// 4. one (possible) final free node
+			const Size freeSize = size() - usedSize;
+			if constexpr (statsOn)
+			{
+				freeMem = freeSize;
+				freeBlocks = freeSize > 0 ? 1 : 0;
+				bytesMoved += usedSize;
+				swaps += static_cast<uint32_t>(order.size());
+				collections++;
+			}
+			if (freeSize > 0)
+			{
+				Assert(freeSize >= MinChunkSize);
+				const auto freeChunk = reinterpret_cast<Chunk*>(base + usedSize);
+				WriteHeaderAndFooter(freeChunk, freeSize, false);
+				freeChunk->SetPrevUsed(true);
+				AddToFreeList(freeChunk);
+			}
 
-			collections++;
+			checkCursor = 0; // old chunk boundaries are gone
+			compactCursor = 0;
+			checkSweepClean = false;
+			TraceEnd(TraceEvent::Compact, usedSize);
+		}
+
+		/**
+		 * \brief Do a bounded piece of compaction. Slides up to maxChunks used chunks following
+		 * the lowest free chunk down over it, which is the same sliding Compact does, spread
+		 * over many calls. Refs are valid after every call, pointers to moved blocks are not.
+		 * Allocations and frees may happen between calls. Cost is O(moved bytes + refs), or
+		 * O(moved bytes) with Policy::blockOwners.
+		 * \param maxChunks the most used chunks to move this call
+		 * \param chunksMoved if not null, set to the number of used chunks moved
+		 * \return bytes moved, 0 when the heap is fully compacted
+		 */
+		Size CompactStep(uint32_t maxChunks, uint32_t* chunksMoved = nullptr)
+		{
+			if (chunksMoved != nullptr)
+				*chunksMoved = 0;
+			EnsureRoot();
+			DrainRemoteFrees();
+			FlushQuickLists();
+
+			// skip the packed used chunks at the bottom
+			Chunk* freeChunk = GetChunkAbsolute(compactCursor);
+			while (freeChunk != nullptr && IsSelfUsed(freeChunk))
+				freeChunk = NextChunk(freeChunk);
+			if (freeChunk == nullptr)
+			{ // heap full
+				compactCursor = 0;
+				return 0;
+			}
+			compactCursor = OffsetOf(freeChunk);
+			const auto first = NextChunk(freeChunk); // used, since free chunks are always merged
+			if (first == nullptr || maxChunks == 0)
+				return 0; // free chunk is last, done
+
+			// run of used chunks to move
+			Size runBytes = 0;
+			uint32_t count = 0;
+			for (auto cur = first; cur != nullptr && IsSelfUsed(cur) && count < maxChunks; cur = NextChunk(cur))
+			{
+				runBytes += cur->GetSize();
+				++count;
+			}
+
+			const auto freeSize = freeChunk->GetSize();
+			const auto src = reinterpret_cast<uint8_t*>(first);
+			const auto dst = reinterpret_cast<uint8_t*>(freeChunk);
+			RemoveFromFreeList(freeChunk);
+			BeginMoves();
+			memmove(dst, src, runBytes);
+			reinterpret_cast<Chunk*>(dst)->SetPrevUsed(true);
+
+			if constexpr (ownersOn)
+			{ // each moved block ends with its Ref, so this costs O(run), not O(refs)
+				for (Size at = 0; at < runBytes; at += reinterpret_cast<Chunk*>(dst + at)->GetSize())
+					refs[OwnerOf(reinterpret_cast<Chunk*>(dst + at))].pointer = dst + at + Base::userDeltaBytes;
+			}
+			else
+			{
+				for (auto& rh : refs)
+				{
+					const auto p = static_cast<uint8_t*>(rh.pointer);
+					if (p >= src && p < src + runBytes)
+						rh.pointer = p - freeSize;
+				}
+			}
+			EndMoves();
+
+			// free chunk now follows the run, merge with any free chunk after it
+			const auto newFree = PlaceChunkRelative(dst, static_cast<int32_t>(runBytes));
+			WriteHeaderAndFooter(newFree, freeSize, false);
+			newFree->SetPrevUsed(true);
+			AddToFreeList(newFree);
+			if (checkCursor >= OffsetOf(freeChunk) && checkCursor < OffsetOf(newFree) + freeSize)
+				checkCursor = OffsetOf(freeChunk); // chunk boundaries moved
+			compactCursor = OffsetOf(newFree);
+			if (const auto next = NextChunk(newFree); next != nullptr && !IsSelfUsed(next))
+				MergeSecondIntoFirst(newFree, next);
+
+			checkSweepClean = false;
+			if constexpr (statsOn)
+			{
+				bytesMoved += runBytes;
+				swaps += count;
+			}
+			if (chunksMoved != nullptr)
+				*chunksMoved = count;
+			return runBytes;
 		}
 
 	private:
-		bool IsSelfUsed(Chunk* chunk) const
+		Size largeObjectThreshold{ 0 }; // 0 is off
+		uint32_t largeLive{ 0 }; // live large objects, kept with stats off too, see Reset
+
+		// type registry, see RegisterType, entry 0 is untyped
+		struct NoTypes {};
+		[[no_unique_address]] std::conditional_t<typesOn, std::array<TypeInfo, Policy::maxTypes + 1>, NoTypes> types{};
+		TypeId typeCount{ 0 };
+
+		// heap profiler state, see SetAllocSite
+		struct Sample
 		{
-			assert(chunk != nullptr);
-			if (const auto next = NextChunk(chunk)) return next->IsPrevUsed();
-			return finalPrevIsUsed;
+			Ref ref;
+			uint32_t site;
+			uint32_t bytes;
+		};
+		struct NoProfile {};
+		[[no_unique_address]] std::conditional_t<profileOn, std::vector<Sample>, NoProfile> samples{}; // live sampled refs
+		[[no_unique_address]] std::conditional_t<profileOn, std::vector<SiteStats>, NoProfile> sites{}; // sorted by site
+		uint32_t allocSite{ 0 };
+		uint32_t sampleCountdown{ 0 }; // bytes until the next sample, 0 before the first AllocRef
+		[[no_unique_address]] std::conditional_t<profileOn, uint64_t, NoProfile> sampleRandom{};
+
+		// allocations a sample of this size stands for, 1 / chance of sampling it, which is
+		// 1 - e^(-bytes/N) with exponential intervals
+		static double SampleWeight(uint32_t bytes)
+		{
+			return 1.0 / -std::expm1(-static_cast<double>(std::max(bytes, 1u)) / Policy::profileSampleBytes);
+		}
+
+		SiteStats& SiteOf(uint32_t site)
+		{
+			auto it = std::lower_bound(sites.begin(), sites.end(), site, [](const SiteStats& s, uint32_t id) { return s.site < id; });
+			if (it == sites.end() || it->site != site)
+				it = sites.insert(it, SiteStats{ site, 0, 0, 0, 0 });
+			return *it;
+		}
+
+		// bytes until the next sample, exponential, mean N, so sampling cannot lock onto a pattern
+		// and each allocation is sampled with a chance that depends only on its size, see SampleWeight
+		uint32_t NextSampleInterval()
+		{
+			sampleRandom = sampleRandom * 6364136223846793005ull + 1442695040888963407ull;
+			const double uniform = static_cast<double>((sampleRandom >> 11) + 1) * 0x1p-53; // in (0, 1]
+			return 1 + static_cast<uint32_t>(std::min(-std::log(uniform) * Policy::profileSampleBytes, 4.0e9));
+		}
+
+		// count down the bytes allocated, sampling the ref that crosses zero
+		void SampleAlloc(const Ref& ref)
+		{
+			const uint32_t bytes = refs[ref].size;
+			if (sampleCountdown == 0)
+				sampleCountdown = NextSampleInterval(); // first AllocRef, the countdown starts zero so static collectors stay in .bss
+			if (sampleCountdown > bytes)
+			{
+				sampleCountdown -= bytes;
+				return;
+			}
+			sampleCountdown = NextSampleInterval();
+
+			samples.push_back(Sample{ ref, allocSite, bytes });
+			refs[ref].sample = static_cast<uint32_t>(samples.size());
+			const auto weight = SampleWeight(bytes);
+			auto& site = SiteOf(allocSite);
+			site.liveObjects += weight;
+			site.liveBytes += weight * bytes;
+			site.allocObjects += weight;
+			site.allocBytes += weight * bytes;
+		}
+
+		// a sampled ref is being freed
+		void Unsample(RefHolder& rh)
+		{
+			const auto index = rh.sample - 1;
+			const auto sample = samples[index];
+			const auto weight = SampleWeight(sample.bytes);
+			auto& site = SiteOf(sample.site);
+			site.liveObjects -= weight;
+			site.liveBytes -= weight * sample.bytes;
+
+			samples[index] = samples.back(); // keep samples dense
+			refs[samples[index].ref].sample = index + 1;
+			samples.pop_back();
+			rh.sample = 0;
+		}
+
+		// add or remove a live ref from its type's stats
+		void CountType([[maybe_unused]] const RefHolder& rh, [[maybe_unused]] int sign)
+		{
+			if constexpr (typesOn && statsOn)
+			{
+				types[rh.type].liveObjects += sign;
+				types[rh.type].liveBytes += sign * static_cast<int>(rh.size);
+			}
+		}
+
+		// open regions share one slice, see PushRegion
+		Ref regionRef{ 0 };       // the slice, when regionDepth is not 0
+		Size regionBytes{ 0 };    // slice size
+		Size regionUsed{ 0 };     // bump cursor into the slice
+		uint32_t regionDepth{ 0 }; // regions open
+
+		static size_t LargeMapBytes(Size requestedByteSize)
+		{
+			return (static_cast<size_t>(requestedByteSize) + PageBytes - 1) / PageBytes * PageBytes;
+		}
+
+		Ref AllocLargeRef(Size requestedByteSize)
+		{
+			TraceInstant(TraceEvent::LargeAlloc, requestedByteSize);
+			const auto ptr = PageAlloc(LargeMapBytes(requestedByteSize));
+			if (ptr == nullptr)
+				return InvalidRef;
+			const auto ref = GetFreeRef(ptr, requestedByteSize);
+			if (ref == InvalidRef)
+			{
+				PageFree(ptr, LargeMapBytes(requestedByteSize));
+				return ref;
+			}
+			refs[ref].refCount |= LargeBit;
+			++largeLive;
+			if constexpr (statsOn)
+			{
+				++largeObjects;
+				largeBytes += requestedByteSize;
+			}
+			return ref;
+		}
+
+		void FreeLarge(void* ptr, Size requestedByteSize)
+		{
+			PageFree(ptr, LargeMapBytes(requestedByteSize));
+			--largeLive;
+			if constexpr (statsOn)
+			{
+				--largeObjects;
+				largeBytes -= requestedByteSize;
+			}
+		}
+
+		// with Policy::blockOwners each pool block ends with its Ref, before any guard, so moving a
+		// block finds its ref without walking the table. Written by AllocRef, and CompactRefs when
+		// renumbering. Without, a block holds its Ref at its start only during Compact
+		static Ref OwnerOf(const Chunk* chunk)
+		{
+			Ref ref;
+			const auto at = ownersOn ? chunk->GetSize() - Base::guardBytes - sizeof(Ref) : Base::userDeltaBytes;
+			std::memcpy(&ref, reinterpret_cast<const uint8_t*>(chunk) + at, sizeof(Ref));
+			return ref;
+		}
+
+		static void SetOwner(void* userData, Ref ref)
+		{
+			const auto chunk = reinterpret_cast<uint8_t*>(userData) - Base::userDeltaBytes;
+			std::memcpy(chunk + reinterpret_cast<Chunk*>(chunk)->GetSize() - Base::guardBytes - sizeof(Ref), &ref, sizeof(Ref));
+		}
+
+		bool IsHotChunk(const Chunk* chunk) const { return IsHotRef(OwnerOf(chunk)); }
+
+		// freeing a Ref that is not live, such as one already freed, would link it into freeRefs twice
+		void CheckLive([[maybe_unused]] const Ref& ref) const
+		{
+			if constexpr (Base::checksOn)
+				if (ref >= refs.size() || refs[ref].pointer == nullptr || (refs[ref].refCount & CountMask) == 0)
+					throw std::runtime_error("Ref not live");
+		}
+
+		// release a live ref's memory and put its entry on the free list
+		void Release(const Ref& ref)
+		{
+			if constexpr (typesOn)
+			{ // before taking rh, a finalizer may free or allocate other refs
+				if (const auto finalize = types[refs[ref].type].finalize)
+					finalize(refs[ref].pointer, refs[ref].size);
+				CountType(refs[ref], -1);
+				refs[ref].type = 0;
+			}
+			if constexpr (profileOn)
+				if (refs[ref].sample != 0)
+					Unsample(refs[ref]);
+			auto& rh = refs[ref];
+			if ((rh.refCount & LargeBit) == 0)
+				FreePtr(rh.pointer);
+			else
+				FreeLarge(rh.pointer, rh.size);
+			rh.pointer = nullptr;
+			rh.size = 0;
+			rh.refCount = freeRefs; // reused first, drops HotBit and LargeBit
+			freeRefs = ref + 1;
+			if constexpr (heatOn) HeatOf(ref).store(0, std::memory_order_relaxed);
+		}
+
+		bool IsHotRef(size_t index) const
+		{
+			if constexpr (heatOn)
+				if (HeatOf(index).load(std::memory_order_relaxed) >= Policy::hotHeat * Policy::heatScale)
+					return true;
+			return (refs[index].refCount & HotBit) != 0;
+		}
+
+		// an entry read from a thread other than the owner, which may be growing the table
+		const RefHolder& SharedRef(const Ref& ref) const
+		{
+			if constexpr (stableRefs)
+				return refs.shared(ref);
+			else
+				return refs[ref];
+		}
+
+		// heat counter of an entry, counted from any thread calling PointerFromRef, so accessed atomically
+		std::atomic_ref<uint16_t> HeatOf(size_t index) const { return std::atomic_ref<uint16_t>(refs[index].heat); }
+
+		// count every PointerFromRef call, saturating, see Heat; racing counts may be lost
+		void CountHeat(const Ref& ref) const
+		{
+			const auto heat = HeatOf(ref);
+			if (const auto count = heat.load(std::memory_order_relaxed); count != UINT16_MAX)
+				heat.store(static_cast<uint16_t>(count + 1), std::memory_order_relaxed);
+		}
+
+		/* Stable partition of the count packed used chunks in [begin, end), hot chunks first,
+		 * by rotating halves in place, so needs no memory and moves O(bytes * log count).
+		 * Returns the start of the cold chunks. Adds bytes rotated to movedBytes.
+		 */
+		uint8_t* PartitionHot(uint8_t* begin, uint8_t* end, uint32_t count, uint32_t& movedBytes)
+		{
+			if (count == 0)
+				return begin;
+			if (count == 1)
+				return IsHotChunk(reinterpret_cast<const Chunk*>(begin)) ? end : begin;
+			auto mid = begin;
+			for (auto i = 0u; i < count / 2; ++i)
+				mid += reinterpret_cast<Chunk*>(mid)->GetSize();
+			const auto leftCold = PartitionHot(begin, mid, count / 2, movedBytes);
+			const auto rightCold = PartitionHot(mid, end, count - count / 2, movedBytes);
+			// [hot][cold | hot][cold] -> [hot][hot][cold][cold]
+			if (leftCold != mid && mid != rightCold)
+			{
+				std::rotate(leftCold, mid, rightCold);
+				const auto bytes = static_cast<uint32_t>(rightCold - leftCold);
+				movedBytes += bytes;
+				if constexpr (statsOn) bytesMoved += bytes;
+			}
+			return leftCold + (rightCold - mid);
 		}
 
 		void MoveUsedUp(Chunk* freeChunk, Chunk* usedChunk)
@@ -730,28 +2813,255 @@ namespace Lomont::Languages {
 
 		}
 
-		Ref GetFreeRef(void* ptr, Size requestedByteSize)
+		// drop free entries at the end of the ref table, keeping its capacity
+		uint32_t TrimFreeRefs()
 		{
-			for (auto i = 0u; i < refs.size(); ++i)
-			{
-				if (refs[i].size == 0)
+			auto count = refs.size();
+			while (count > 0 && refs[count - 1].pointer == nullptr)
+				--count;
+			const auto dropped = static_cast<uint32_t>(refs.size() - count);
+			refs.resize(count);
+
+			// relink the rest, lowest reused first, so the table tends to stay short
+			freeRefs = 0;
+			for (auto i = count; i-- > 0;)
+				if (refs[i].pointer == nullptr)
 				{
-					refs[i].size = requestedByteSize;
-					refs[i].pointer = ptr;
-					refs[i].refCount = 1;
-					return i;
+					refs[i].refCount = freeRefs;
+					freeRefs = static_cast<Ref>(i + 1);
 				}
+			return dropped;
+		}
+
+		Ref GetFreeRef(void* ptr, Size requestedByteSize)
+		{
+			if (freeRefs != 0)
+			{
+				const Ref ref = freeRefs - 1;
+				auto& rh = refs[ref];
+				freeRefs = rh.refCount;
+				rh.size = requestedByteSize;
+				rh.pointer = ptr;
+				rh.refCount = 1;
+				CountType(rh, 1);
+				if constexpr (profileOn) SampleAlloc(ref);
+				return ref;
 			}
+			if (refs.size() >= InvalidRef || refs.size() == refs.max_size())
+				return InvalidRef; // every Ref in use
 			RefHolder rh;
 			rh.pointer = ptr;
 			rh.refCount = 1;
 			rh.size = requestedByteSize;
 			refs.push_back(rh);
+			CountType(rh, 1);
+			if constexpr (profileOn) SampleAlloc(static_cast<Ref>(refs.size() - 1));
 			return static_cast<Ref>(refs.size() - 1);
 		}
 
 		// where we store
-		std::vector<RefHolder> refs;
+		typename Policy::template RefTable<RefHolder> refs;
+		// free entries in refs, linked through refCount, holding the Ref plus 1, so 0 is the empty list
+		Ref freeRefs{ 0 };
+
+		// Compact saves the first bytes of each block here while the block holds its Ref,
+		// and CompactInOrder marks placed refs here
+		typename Policy::template RefTable<Ref> backing;
+
+		// blocks freed by RemoteFreeRef, see Base::remoteFrees
+		std::atomic<Size> remoteRefFrees{ 0 };
+
+		// odd while blocks or refs are moving, see ReadBegin
+		std::atomic<uint32_t> moveSequence{ 0 };
+
+		void BeginMoves()
+		{
+			moveSequence.store(moveSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+		void EndMoves()
+		{
+			moveSequence.store(moveSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	using GarbageCollector = BasicGarbageCollector<>;
+	using SmallGarbageCollector = BasicGarbageCollector<SmallPolicy<>>; // pools under 64K
+
+	// GarbageCollector with its pool and ref table inside the object, see StaticPolicy
+	template<uint32_t HeapBytes, uint32_t MaxRefs>
+	using StaticGarbageCollector = BasicGarbageCollector<StaticPolicy<HeapBytes, MaxRefs>>;
+
+	/* Spread GarbageCollector work over frames of a frame based application.
+	 * Call Tick once per frame with the time the frame can spare. Each Tick does the
+	 * deferred DecrRefs, then incremental compaction with CompactStep. Compaction is paced
+	 * to the allocation rate: each byte allocated adds compactionFactor bytes of moving work,
+	 * and while the heap has more than maxFreeBlocks free blocks, the whole budget is used.
+	 * Keeping ahead of fragmentation this way avoids needing a blocking Compact.
+	 * The pool is fixed, so there are no free pages to release.
+	 * Requires Stats::On. Set Policy::blockOwners with many refs, so each step costs
+	 * O(bytes moved) instead of O(refs). Clock is any std::chrono clock, replaceable for tests.
+	 */
+	template<typename GC, typename Clock = std::chrono::steady_clock>
+	class FrameScheduler
+	{
+		static_assert(GC::PolicyType::stats == Stats::On, "FrameScheduler needs allocator stats");
+	public:
+		using Ref = typename GC::Ref;
+
+		explicit FrameScheduler(GC& gc) : gc(gc), lastBytesAllocated(gc.bytesAllocated) {}
+
+		// bytes of compaction per byte allocated
+		uint32_t compactionFactor{ 2 };
+		// above this many free blocks, all spare budget goes to compaction
+		uint32_t maxFreeBlocks{ 8 };
+
+		// stats
+		uint32_t ticks{ 0 }, overBudgetTicks{ 0 }, steps{ 0 };
+
+		/**
+		 * \brief DecrRef a Ref during a later Tick, instead of now
+		 * \param ref the Ref to release
+		 */
+		void DeferDecrRef(Ref ref) { deferred.push_back(ref); }
+
+		// number of DecrRefs not yet done
+		[[nodiscard]] size_t DeferredCount() const { return deferred.size() - deferredDone; }
+
+		/**
+		 * \brief Do deferred GC work for at most about timeBudgetMicros
+		 * \param timeBudgetMicros time to spend, in microseconds
+		 * \return microseconds used
+		 */
+		uint32_t Tick(uint32_t timeBudgetMicros)
+		{
+			const auto start = Clock::now();
+			const auto deadline = start + std::chrono::microseconds(timeBudgetMicros);
+			++ticks;
+
+			// 1. deferred frees, oldest first, checking the clock every few
+			while (deferredDone < deferred.size())
+			{
+				gc.DecrRef(deferred[deferredDone++]);
+				if ((deferredDone & 15) == 0 && Clock::now() >= deadline)
+					break;
+			}
+			if (deferredDone == deferred.size())
+			{
+				deferred.clear();
+				deferredDone = 0;
+			}
+
+			// 2. compaction, paced by allocation
+			const uint32_t allocated = gc.bytesAllocated - lastBytesAllocated; // wraps ok
+			lastBytesAllocated = gc.bytesAllocated;
+			compactionDebt += static_cast<uint64_t>(allocated) * compactionFactor;
+
+			auto now = Clock::now();
+			const auto stepsBefore = steps;
+			while (now < deadline && (compactionDebt > 0 || gc.freeBlocks > maxFreeBlocks))
+			{
+				// size batch to the time left, from the measured costs per step and per chunk
+				const auto left = std::chrono::duration<double, std::nano>(deadline - now).count() - nanosPerStep;
+				if (left <= 0 && steps != stepsBefore)
+					break; // another step would not fit, but always take one so the estimates adapt
+				const auto batch = static_cast<uint32_t>(std::clamp(left / nanosPerChunk, 1.0, 4096.0));
+				const auto swapsBefore = gc.swaps;
+				const auto moved = gc.CompactStep(batch);
+				const auto after = Clock::now();
+				++steps;
+				if (moved == 0)
+				{ // fully compacted, nothing owed
+					compactionDebt = 0;
+					break;
+				}
+				compactionDebt -= std::min<uint64_t>(compactionDebt, moved);
+				// split the time into a fixed part and a part per chunk actually moved
+				const auto took = std::chrono::duration<double, std::nano>(after - now).count();
+				const auto chunks = static_cast<double>(gc.swaps - swapsBefore);
+				nanosPerStep = std::max(0.0, 0.75 * nanosPerStep + 0.25 * (took - chunks * nanosPerChunk));
+				nanosPerChunk = std::max(1.0, 0.75 * nanosPerChunk + 0.25 * std::max(0.0, took - nanosPerStep) / std::max(chunks, 1.0));
+				now = after;
+			}
+
+			const auto used = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+			if (used > timeBudgetMicros)
+				++overBudgetTicks;
+			return static_cast<uint32_t>(used);
+		}
+
+	private:
+		GC& gc;
+		std::vector<Ref> deferred;
+		size_t deferredDone{ 0 };
+		uint32_t lastBytesAllocated;
+		uint64_t compactionDebt{ 0 };
+		double nanosPerChunk{ 100.0 }; // running estimates, adapt to the heap
+		double nanosPerStep{ 0.0 };
 	};
 
+	/**
+	 * \brief Append a binary heap map snapshot of an Allocator or GarbageCollector to a stream.
+	 * Snapshots may be concatenated into one file, and viewed with HeapMapTool.
+	 * Format, all little endian:
+	 *   "GCHM", u32 version (1), u64 timestamp, u32 heap size, u32 chunk count,
+	 *   then per chunk in address order: u32 offset, u32 size, u8 used, u32 owner
+	 * \param heap the heap to walk
+	 * \param os binary stream to write to
+	 * \param timestamp caller defined time of the snapshot, such as a frame number
+	 */
+	template<typename Heap>
+	void WriteHeapMap(Heap& heap, std::ostream& os, uint64_t timestamp)
+	{
+		auto put = [&os](uint64_t value, int bytes)
+			{
+				for (int i = 0; i < bytes; ++i)
+					os.put(static_cast<char>((value >> (8 * i)) & 255));
+			};
+
+		uint32_t count = 0; // a counting pass, so chunks need not be stored
+		heap.ForEachChunk([&](const typename Heap::ChunkInfo&) { ++count; });
+
+		os.write("GCHM", 4);
+		put(1, 4);
+		put(timestamp, 8);
+		put(heap.size(), 4);
+		put(count, 4);
+		heap.ForEachChunk([&](const typename Heap::ChunkInfo& c)
+			{
+				put(c.offset, 4);
+				put(c.size, 4);
+				put(c.used ? 1 : 0, 1);
+				put(c.owner, 4);
+			});
+	}
+
+	/**
+	 * \brief Write a collector's sampled heap profile in pprof's legacy heap text format,
+	 * as a one frame stack per allocation site, which pprof shows with the site id as the
+	 * address. Needs Policy::profileSampleBytes nonzero. Read it with:
+	 *   go tool pprof -top -addresses -inuse_space file
+	 * \param gc the collector
+	 * \param os the stream to write to
+	 */
+	template<typename GC>
+	void WriteHeapProfile(const GC& gc, std::ostream& os)
+	{
+		const auto whole = [](double value) { return static_cast<uint64_t>(std::max(value, 0.0) + 0.5); };
+		double liveObjects = 0, liveBytes = 0, allocObjects = 0, allocBytes = 0;
+		for (const auto& site : gc.Sites())
+		{
+			liveObjects += site.liveObjects;
+			liveBytes += site.liveBytes;
+			allocObjects += site.allocObjects;
+			allocBytes += site.allocBytes;
+		}
+		os << "heap profile: " << whole(liveObjects) << ": " << whole(liveBytes)
+			<< " [" << whole(allocObjects) << ": " << whole(allocBytes) << "] @ heapprofile\n";
+		for (const auto& site : gc.Sites())
+			os << whole(site.liveObjects) << ": " << whole(site.liveBytes)
+				<< " [" << whole(site.allocObjects) << ": " << whole(site.allocBytes) << "] @ 0x"
+				<< std::hex << site.site + 1ull << std::dec << "\n"; // pprof takes addresses as return addresses, subtracting 1
+	}
+
 }//namespace Lomont::Languages
\ No newline at end of file
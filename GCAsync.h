@@ -0,0 +1,152 @@
+/*
+MIT License
+
+Copyright (c) 2023 Chris Lomont
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ */
+
+// Chris Lomont
+// C++20 coroutine compaction for the GarbageCollector.
+// Kept out of GC.h so targets without coroutine support need not include <coroutine>.
+
+#pragma once
+
+#include "GC.h"
+
+#include <coroutine>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace Lomont::Languages {
+
+	/* Lazily started coroutine task returned by CompactAsync.
+	 * co_await it from another coroutine to run it, which gives the bytes moved.
+	 */
+	class CompactTask
+	{
+	public:
+		struct promise_type
+		{
+			std::coroutine_handle<> continuation{ std::noop_coroutine() };
+			std::exception_ptr error;
+			uint64_t bytesMoved{ 0 };
+
+			CompactTask get_return_object() { return CompactTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+
+			// resume whoever awaited this task
+			struct FinalAwaiter
+			{
+				bool await_ready() noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept { return h.promise().continuation; }
+				void await_resume() noexcept {}
+			};
+			FinalAwaiter final_suspend() noexcept { return {}; }
+
+			void return_value(uint64_t bytes) { bytesMoved = bytes; }
+			void unhandled_exception() { error = std::current_exception(); }
+		};
+
+		CompactTask(CompactTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+		CompactTask& operator=(CompactTask&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (handle) handle.destroy();
+				handle = std::exchange(other.handle, {});
+			}
+			return *this;
+		}
+		CompactTask(const CompactTask&) = delete;
+		CompactTask& operator=(const CompactTask&) = delete;
+		~CompactTask() { if (handle) handle.destroy(); }
+
+		// awaiting starts the task, and resumes the awaiter when it finishes
+		bool await_ready() const noexcept { return handle.done(); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+		{
+			handle.promise().continuation = awaiter;
+			return handle;
+		}
+		uint64_t await_resume() const
+		{
+			if (handle.promise().error)
+				std::rethrow_exception(handle.promise().error);
+			return handle.promise().bytesMoved;
+		}
+
+		// for callers that are not coroutines: run until the next suspension, true when finished
+		bool Resume()
+		{
+			if (!handle.done())
+				handle.resume();
+			return handle.done();
+		}
+
+	private:
+		explicit CompactTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	// the coroutine behind CompactAsync, which checks its arguments first
+	template<typename GC, typename Yield>
+	CompactTask CompactBatches(GC& gc, Yield yield, uint32_t chunksPerBatch)
+	{
+		uint64_t bytesMoved = 0;
+		for (;;)
+		{
+			// each step stops at the next free chunk, so take steps until the batch is used
+			uint32_t batchChunks = 0;
+			while (batchChunks < chunksPerBatch)
+			{
+				uint32_t chunks = 0;
+				const auto moved = gc.CompactStep(chunksPerBatch - batchChunks, &chunks);
+				if (moved == 0)
+					co_return bytesMoved;
+				bytesMoved += moved;
+				batchChunks += chunks;
+			}
+			co_await yield();
+		}
+	}
+
+	/**
+	 * \brief Compact a collector from a coroutine, a batch of chunks at a time, awaiting the
+	 * scheduler between batches. Uses the same sliding as Compact, through CompactStep, so refs
+	 * are consistent at every suspension, and other coroutines can keep allocating, freeing, and
+	 * reading by Ref. Raw pointers to blocks are invalidated across suspensions, as with Compact.
+	 * \param gc the collector to compact
+	 * \param yield callable returning an awaitable that suspends to the scheduler, such as
+	 *        [&]{ return scheduler.Yield(); }
+	 * \param chunksPerBatch the most used chunks moved between suspensions, at least 1, else
+	 *        this throws at once, before any task is made
+	 * \return task giving the total bytes moved
+	 */
+	template<typename GC, typename Yield>
+	CompactTask CompactAsync(GC& gc, Yield yield, uint32_t chunksPerBatch = 64)
+	{
+		if (chunksPerBatch == 0)
+			throw std::runtime_error("Bad chunks per batch");
+		return CompactBatches(gc, std::move(yield), chunksPerBatch);
+	}
+
+}//namespace Lomont::Languages
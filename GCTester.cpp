@@ -26,14 +26,48 @@ SOFTWARE.
 // simple testing for Chris Lomont's Tiny C++ Garbage Collector
 
 #include "GC.h"
+#include "GCAsync.h"
+#include "GCThreadHeaps.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 
 
 using namespace std;
 using GC = Lomont::Languages::GarbageCollector;
 
+// global allocation is replaced, so checks can count heap allocations and make one fail
+std::atomic<uint64_t> heapAllocations{ 0 };
+std::atomic<int64_t> allocationsBeforeFailure{ -1 }; // the allocation after this many throws, negative never
+
+void* operator new(std::size_t bytes)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (allocationsBeforeFailure.load(std::memory_order_relaxed) >= 0 &&
+		allocationsBeforeFailure.fetch_sub(1, std::memory_order_relaxed) == 0)
+		throw std::bad_alloc();
+	if (const auto p = std::malloc(bytes != 0 ? bytes : 1))
+		return p;
+	throw std::bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // sees free inlined into deletes of new memory
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
 void CheckSize(uint32_t requestSize, uint32_t returnedSize)
 {
 	
@@ -70,8 +104,44 @@ void TestAllBlocks(const std::vector<std::pair<GC::Ref, uint32_t>>& pointers, co
 		CheckBlock(gc, ref, requestSize);
 }
 
+// constant initialized, so it lives in .bss and runs no startup code
+constinit Lomont::Languages::StaticGarbageCollector<16 * 1024, 256> staticGC;
+
+// the static collector works with no heap allocation at all
+void CheckStaticGC()
+{
+	using Static = decltype(staticGC);
+	const auto allocationsBefore = heapAllocations.load();
+	staticGC.Reset();
+	Static::Ref refs[256];
+	uint32_t count = 0;
+	while (count < 256 && (refs[count] = staticGC.AllocRef(8 + count % 40)) != Static::InvalidRef)
+	{
+		std::memset(staticGC.PointerFromRef(refs[count]), static_cast<uint8_t>(count), staticGC.SizeFromRef(refs[count]));
+		++count;
+	}
+	if (count < 200 || staticGC.AllocRef(8) != Static::InvalidRef)
+		throw std::runtime_error("static collector limits wrong");
+	for (uint32_t i = 0; i < count; i += 2)
+		staticGC.DecrRef(refs[i]);
+	staticGC.IntegrityCheck();
+	staticGC.CompactStep(16);
+	staticGC.Compact();
+	staticGC.IntegrityCheck();
+	for (uint32_t i = 1; i < count; i += 2)
+		if (static_cast<const uint8_t*>(staticGC.PointerFromRef(refs[i]))[0] != static_cast<uint8_t>(i))
+			throw std::runtime_error("static collector memory changed");
+	if (staticGC.freeBlocks != 1)
+		throw std::runtime_error("static collector did not compact");
+	staticGC.Reset();
+	if (heapAllocations.load() != allocationsBefore)
+		throw std::runtime_error("static collector allocated");
+}
+
 void CheckGC()
 {
+	CheckStaticGC();
+
 	// store the ref, and the size we requested
 	std::vector<std::pair<GC::Ref,uint32_t>> pointers;
 
@@ -84,6 +154,7 @@ void CheckGC()
 	{
 		++pass;
 		gc.IntegrityCheck();
+		gc.IntegrityCheckIncremental(8); // exercise the incremental check too
 		if (gc.usedBlocks != pointers.size())
 			throw std::runtime_error("block count wrong");
 		std::cout << std::format("{}: Mem used {}({}) free {}({}) total {} collections {} swaps {} merges {} allocs {} frees {} bytes moved {} alloc fails {} retry fails {}, ",
@@ -272,8 +343,1860 @@ void CheckMem()
 	}
 }
 
-int main()
+// each thread does opsPerThread allocs and frees, keeping a window of live objects
+// compares one heap per thread against all threads sharing one heap behind a mutex
+void BenchThreadHeaps()
+{
+	using Heaps = Lomont::Languages::ThreadHeaps<>;
+	constexpr int opsPerThread = 1'000'000;
+	constexpr size_t window = 256;
+	constexpr uint32_t heapBytes = 1'000'000;
+	const auto maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	// run body on each of threadCount threads, return millions of ops per second
+	auto timeThreads = [](uint32_t threadCount, auto body)
+		{
+			const auto start = chrono::steady_clock::now();
+			std::vector<std::thread> threads;
+			for (auto t = 0u; t < threadCount; ++t)
+				threads.emplace_back(body, t);
+			for (auto& t : threads)
+				t.join();
+			const chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+			return threadCount * static_cast<double>(opsPerThread) / seconds.count() / 1e6;
+		};
+
+	std::cout << "threads  shared heap Mops/s  thread heaps Mops/s  handoffs\n";
+	for (auto threadCount = 1u; threadCount <= maxThreads; threadCount *= 2)
+	{
+		// baseline: one collector, one lock
+		GC shared(heapBytes * threadCount);
+		std::mutex lock;
+		const auto sharedRate = timeThreads(threadCount, [&](uint32_t t)
+			{
+				std::vector<GC::Ref> live;
+				uint32_t seed = t + 1;
+				for (int i = 0; i < opsPerThread; ++i)
+				{
+					seed = seed * 1664525 + 1013904223;
+					std::lock_guard guard(lock);
+					if (live.size() < window)
+					{
+						auto ref = shared.AllocRef(8 + (seed >> 25));
+						if (ref == GC::InvalidRef)
+						{
+							shared.Compact();
+							ref = shared.AllocRef(8 + (seed >> 25));
+						}
+						static_cast<uint8_t*>(shared.PointerFromRef(ref))[0] = 1;
+						live.push_back(ref);
+					}
+					else
+					{
+						const auto j = (seed >> 8) % live.size();
+						shared.DecrRef(live[j]);
+						live[j] = live.back();
+						live.pop_back();
+					}
+				}
+				std::lock_guard guard(lock);
+				for (const auto ref : live)
+					shared.DecrRef(ref);
+			});
+
+		// one heap per thread, each thread's leftovers released by the next thread
+		Heaps heaps(threadCount, heapBytes, 2 * window);
+		std::vector<std::vector<Heaps::Ref>> leftovers(threadCount);
+		std::atomic<uint32_t> finished{ 0 };
+		const auto heapRate = timeThreads(threadCount, [&](uint32_t t)
+			{
+				heaps.AttachThread(t);
+				auto& live = leftovers[t];
+				uint32_t seed = t + 1;
+				for (int i = 0; i < opsPerThread; ++i)
+				{
+					seed = seed * 1664525 + 1013904223;
+					if (live.size() < window)
+					{
+						auto ref = heaps.AllocRef(8 + (seed >> 25));
+						if (ref == Heaps::InvalidRef)
+						{
+							heaps.Compact();
+							ref = heaps.AllocRef(8 + (seed >> 25));
+						}
+						static_cast<uint8_t*>(heaps.PointerFromRef(ref))[0] = 1;
+						live.push_back(ref);
+					}
+					else
+					{
+						const auto j = (seed >> 8) % live.size();
+						heaps.DecrRef(live[j]);
+						live[j] = live.back();
+						live.pop_back();
+					}
+				}
+				// cross thread release, then wait for all before draining our own
+				++finished;
+				while (finished < threadCount)
+					std::this_thread::yield();
+				for (const auto ref : leftovers[(t + threadCount - 1) % threadCount])
+					heaps.DecrRef(ref);
+				++finished;
+				while (finished < 2 * threadCount)
+					std::this_thread::yield();
+				heaps.DrainHandoffs();
+			});
+
+		uint32_t used = 0;
+		for (auto i = 0u; i < threadCount; ++i)
+			used += heaps.HeapAt(i).usedBlocks;
+		if (used != 0 || shared.usedBlocks != 0)
+			throw std::runtime_error("blocks leaked");
+
+		std::cout << std::format("{:7}  {:19.2f}  {:19.2f}  {:8}\n", threadCount, sharedRate, heapRate, threadCount * window);
+	}
+}
+
+// results of one RunWorkload
+struct WorkloadResult
+{
+	uint32_t allocations{ 0 }, fails{ 0 }, collections{ 0 }, peakBlocks{ 0 };
+	uint64_t liveBytes{ 0 }; // requested bytes live, summed over passes
+};
+
+// how RunWorkload compacts when an allocation fails
+enum class WorkloadCompact { Full, Steps, InOrder };
+
+// collector features RunWorkload exercises beyond allocating and freeing
+struct WorkloadOptions
+{
+	WorkloadCompact compact{ WorkloadCompact::Full };
+	uint32_t largeObjectBytes{ 0 }; // nonzero sends requests this big to the large object space
+	bool compactRefs{ false };      // renumber refs with CompactRefs every 1000 passes
+};
+
+// random small object churn with compaction on failure, checking contents and heap integrity
+// same seed gives the same requests for any collector type
+template<typename TGC>
+WorkloadResult RunWorkload(uint32_t memorySize, int passes, const WorkloadOptions& options = {})
+{
+	std::vector<std::pair<typename TGC::Ref, uint32_t>> pointers;
+	WorkloadResult result;
+	TGC gc(memorySize);
+	if (options.largeObjectBytes != 0)
+		gc.SetLargeObjectThreshold(options.largeObjectBytes);
+	srand(4321);
+	auto check = [&](typename TGC::Ref ref, uint32_t requestSize)
+		{
+			const auto memptr = static_cast<const uint8_t*>(gc.PointerFromRef(ref));
+			if (gc.SizeFromRef(ref) != requestSize || memptr[0] != static_cast<uint8_t>(ref) || memptr[requestSize - 1] != static_cast<uint8_t>(ref))
+				throw runtime_error("memory changed");
+		};
+	uint64_t requested = 0;
+	for (int pass = 0; pass < passes; ++pass)
+	{
+		gc.IntegrityCheckIncremental(8);
+		if (pass % 1000 == 0)
+			gc.IntegrityCheck();
+		if (rand() % 100 > 48)
+		{
+			const auto requestSize = static_cast<uint32_t>(rand() % 4 == 0 ? rand() % 256 + 1 : rand() % 24 + 1);
+			auto ref = gc.AllocRef(requestSize);
+			if (ref == TGC::InvalidRef)
+			{
+				++result.fails;
+				if (options.compact == WorkloadCompact::Steps)
+					while (gc.CompactStep(16) != 0) {}
+				else if (options.compact == WorkloadCompact::InOrder)
+					gc.CompactInOrder([&](auto&& place)
+						{ // newest first, so order differs from address order
+							for (auto it = pointers.rbegin(); it != pointers.rend(); ++it)
+								place(it->first);
+						});
+				else
+					gc.Compact();
+				for (const auto& [r, size] : pointers)
+					check(r, size);
+				ref = gc.AllocRef(requestSize);
+			}
+			if (ref != TGC::InvalidRef)
+			{
+				const auto memptr = static_cast<uint8_t*>(gc.PointerFromRef(ref));
+				memptr[0] = memptr[requestSize - 1] = static_cast<uint8_t>(ref);
+				pointers.emplace_back(ref, requestSize);
+				requested += requestSize;
+			}
+		}
+		else if (!pointers.empty())
+		{
+			const auto i = rand() % pointers.size();
+			const auto [ref, requestSize] = pointers[i];
+			pointers.erase(pointers.begin() + i);
+			check(ref, requestSize);
+			requested -= requestSize;
+			gc.DecrRef(ref);
+		}
+		if (options.compactRefs && pass % 1000 == 999)
+		{ // blocks are stamped with their ref, so restamp renumbered ones
+			std::vector<typename TGC::Ref> renumbered(gc.RefTableSize(), TGC::InvalidRef);
+			gc.CompactRefs([&](auto oldRef, auto newRef) { renumbered[oldRef] = newRef; });
+			for (auto& [ref, requestSize] : pointers)
+				if (renumbered[ref] != TGC::InvalidRef)
+				{
+					ref = renumbered[ref];
+					const auto memptr = static_cast<uint8_t*>(gc.PointerFromRef(ref));
+					memptr[0] = memptr[requestSize - 1] = static_cast<uint8_t>(ref);
+				}
+		}
+		result.peakBlocks = std::max(result.peakBlocks, static_cast<uint32_t>(pointers.size()));
+		result.liveBytes += requested;
+	}
+	gc.IntegrityCheck();
+	result.allocations = gc.allocations;
+	result.collections = gc.collections;
+	return result;
+}
+
+// run the same workload with 32 and 16 bit Size and Ref on a small pool
+void CompareWidths()
+{
+	constexpr uint32_t memorySize = 32 * 1024;
+	constexpr int passes = 200'000;
+	std::cout << "width  allocations  fails  collections  peak blocks  avg live bytes\n";
+	auto report = [](const char* name, const WorkloadResult& r)
+		{
+			std::cout << std::format("{:5}  {:11}  {:5}  {:11}  {:11}  {:14}\n", name, r.allocations, r.fails, r.collections, r.peakBlocks, r.liveBytes / passes);
+		};
+	report("32", RunWorkload<Lomont::Languages::GarbageCollector>(memorySize, passes));
+	report("16", RunWorkload<Lomont::Languages::SmallGarbageCollector>(memorySize, passes));
+}
+
+struct TinyChunkPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr bool tinyChunks = true;
+};
+
+struct BlockOwnersPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr bool blockOwners = true;
+};
+
+struct TinyOwnersPolicy : TinyChunkPolicy
+{
+	static constexpr bool blockOwners = true;
+};
+
+struct AddressOrderedPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr auto freeList = Lomont::Languages::FreeList::AddressOrdered;
+};
+
+// quick list flushes insert into ordered bins
+struct QuickAddressPolicy : AddressOrderedPolicy
+{
+	static constexpr uint32_t quickListBytes = 48;
+};
+
+// run the workload under policies and features the default CheckGC does not cover
+void CheckPolicies()
+{
+	using Lomont::Languages::BasicGarbageCollector;
+	using Lomont::Languages::GarbageCollector;
+	constexpr uint32_t memorySize = 32 * 1024;
+	constexpr int passes = 200'000;
+	std::cout << "policy            allocations  fails  collections  peak blocks  avg live bytes\n";
+	auto report = [](const char* name, const WorkloadResult& r)
+		{
+			std::cout << std::format("{:16}  {:11}  {:5}  {:11}  {:11}  {:14}\n", name, r.allocations, r.fails, r.collections, r.peakBlocks, r.liveBytes / passes);
+		};
+	report("default", RunWorkload<GarbageCollector>(memorySize, passes));
+	report("tiny chunks", RunWorkload<BasicGarbageCollector<TinyChunkPolicy>>(memorySize, passes));
+	report("paranoid", RunWorkload<BasicGarbageCollector<Lomont::Languages::AllocatorPolicy<Lomont::Languages::Checks::Paranoid>>>(memorySize, passes));
+	report("address ordered", RunWorkload<BasicGarbageCollector<AddressOrderedPolicy>>(memorySize, passes));
+	report("quick, address", RunWorkload<BasicGarbageCollector<QuickAddressPolicy>>(memorySize, passes));
+	report("large objects", RunWorkload<GarbageCollector>(memorySize, passes, { .largeObjectBytes = 200 }));
+	report("compact steps", RunWorkload<GarbageCollector>(memorySize, passes, { .compact = WorkloadCompact::Steps }));
+	report("block owners", RunWorkload<BasicGarbageCollector<BlockOwnersPolicy>>(memorySize, passes, { .compact = WorkloadCompact::Steps }));
+	report("compact in order", RunWorkload<GarbageCollector>(memorySize, passes, { .compact = WorkloadCompact::InOrder }));
+	report("compact refs", RunWorkload<GarbageCollector>(memorySize, passes, { .compactRefs = true }));
+}
+
+// time to set up a heap, against zero filling the pool as the constructor used to
+void BenchStartup()
+{
+	auto millis = [](auto body)
+		{
+			const auto start = chrono::steady_clock::now();
+			body();
+			return chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+		};
+	std::cout << "pool MB  zero filled ms  constructor ms  first alloc ms\n";
+	for (const uint32_t megabytes : { 1u, 64u, 1024u })
+	{
+		const uint32_t bytes = megabytes << 20;
+		const auto zeroFilled = millis([&] { std::vector<uint8_t> pool(bytes); if (pool[bytes / 2] != 0) throw runtime_error("not zero"); });
+		std::unique_ptr<GC> gc;
+		const auto construct = millis([&] { gc = std::make_unique<GC>(bytes); });
+		const auto firstAlloc = millis([&] { if (gc->AllocRef(64) == GC::InvalidRef) throw runtime_error("alloc failed"); });
+		std::cout << std::format("{:7}  {:14.3f}  {:14.3f}  {:14.3f}\n", megabytes, zeroFilled, construct, firstAlloc);
+	}
+}
+
+// linked list scattered over the heap, walked before compaction, after address order
+// Compact, and after CompactInOrder along the list
+void BenchTraversal()
+{
+	struct Node
+	{
+		GC::Ref next;
+		uint32_t value;
+		uint8_t payload[56];
+	};
+	constexpr uint32_t nodeCount = 200'000;
+	GC gc(64u << 20);
+	gc.ReserveRefs(2 * nodeCount);
+
+	// allocate nodes interleaved with garbage, then link them in a random order
+	srand(1234);
+	std::vector<GC::Ref> nodes, garbage;
+	for (auto i = 0u; i < nodeCount; ++i)
+	{
+		nodes.push_back(gc.AllocRef(sizeof(Node)));
+		garbage.push_back(gc.AllocRef(rand() % 200 + 1));
+	}
+	for (auto i = nodeCount - 1; i > 0; --i)
+		std::swap(nodes[i], nodes[rand() % (i + 1)]);
+	for (auto i = 0u; i < nodeCount; ++i)
+	{
+		auto node = static_cast<Node*>(gc.PointerFromRef(nodes[i]));
+		node->next = i + 1 < nodeCount ? nodes[i + 1] : GC::InvalidRef;
+		node->value = i;
+	}
+	for (const auto ref : garbage)
+		gc.DecrRef(ref);
+	const auto head = nodes[0];
+
+	auto walk = [&]
+		{
+			uint64_t sum = 0;
+			const auto start = chrono::steady_clock::now();
+			for (auto pass = 0; pass < 10; ++pass)
+				for (auto ref = head; ref != GC::InvalidRef;)
+				{
+					const auto node = static_cast<const Node*>(gc.PointerFromRef(ref));
+					sum += node->value;
+					ref = node->next;
+				}
+			const auto nanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+			if (sum != 10ull * nodeCount * (nodeCount - 1) / 2)
+				throw runtime_error("list damaged");
+			return nanos / (10.0 * nodeCount);
+		};
+
+	std::cout << "layout              ns per node\n";
+	std::cout << std::format("scattered           {:11.2f}\n", walk());
+	gc.Compact();
+	std::cout << std::format("Compact             {:11.2f}\n", walk());
+	gc.CompactInOrder([&](auto&& place)
+		{
+			for (auto ref = head; ref != GC::InvalidRef; ref = static_cast<const Node*>(gc.PointerFromRef(ref))->next)
+				place(ref);
+		});
+	std::cout << std::format("CompactInOrder      {:11.2f}\n", walk());
+	gc.IntegrityCheck();
+}
+
+// cost of PointerFromRef with heat counting compiled out, and on at two scales
+template<typename TGC>
+double TimePointerFromRef()
+{
+	constexpr uint32_t refCount = 1000, rounds = 20'000;
+	TGC gc(1u << 20);
+	std::vector<typename TGC::Ref> refs;
+	for (auto i = 0u; i < refCount; ++i)
+	{
+		refs.push_back(gc.AllocRef(16));
+		*static_cast<uint32_t*>(gc.PointerFromRef(refs.back())) = i;
+	}
+	uint64_t sum = 0;
+	const auto start = chrono::steady_clock::now();
+	for (auto round = 0u; round < rounds; ++round)
+		for (const auto ref : refs)
+			sum += *static_cast<const uint32_t*>(gc.PointerFromRef(ref));
+	const auto nanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+	if (sum != uint64_t{ rounds } * refCount * (refCount - 1) / 2)
+		throw runtime_error("bad sum");
+	return nanos / (double{ rounds } * refCount);
+}
+
+template<uint32_t rate>
+struct HeatPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr uint32_t heatScale = rate;
+};
+
+void BenchHeat()
+{
+	using Lomont::Languages::BasicGarbageCollector;
+	std::cout << "heat          ns per PointerFromRef\n";
+	std::cout << std::format("off           {:9.3f}\n", TimePointerFromRef<GC>());
+	std::cout << std::format("scale 1       {:9.3f}\n", TimePointerFromRef<BasicGarbageCollector<HeatPolicy<1>>>());
+	std::cout << std::format("scale 256     {:9.3f}\n", TimePointerFromRef<BasicGarbageCollector<HeatPolicy<256>>>());
+}
+
+template<Lomont::Languages::FreeList order>
+struct FreeListPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr auto freeList = order;
+};
+
+// churn on an Allocator, timing ops, and measuring fragmentation and reuse locality
+template<Lomont::Languages::FreeList order>
+void ChurnFreeList(const char* name)
 {
+	using Alloc = Lomont::Languages::BasicAllocator<FreeListPolicy<order>>;
+	constexpr uint32_t poolBytes = 4u << 20;
+	constexpr int ops = 2'000'000;
+	Alloc alloc(poolBytes);
+	std::vector<std::pair<uint8_t*, uint32_t>> live;
+	srand(2024);
+	uint32_t fails = 0;
+	uint64_t distance = 0, allocs = 0;
+	const uint8_t* last = nullptr;
+	const auto start = chrono::steady_clock::now();
+	for (int op = 0; op < ops; ++op)
+	{
+		if (live.size() < 20'000 && rand() % 100 < 52)
+		{
+			const auto bytes = static_cast<uint32_t>(rand() % 16 == 0 ? rand() % 2000 + 200 : rand() % 48 + 16);
+			const auto p = static_cast<uint8_t*>(alloc.AllocPtr(bytes));
+			if (p == static_cast<void*>(Alloc::InvalidAlloc))
+			{
+				++fails;
+				continue;
+			}
+			std::memset(p, op, bytes); // touch it, as a mutator would
+			if (last != nullptr)
+				distance += p > last ? p - last : last - p;
+			last = p;
+			++allocs;
+			live.emplace_back(p, bytes);
+		}
+		else if (!live.empty())
+		{
+			const auto i = rand() % live.size();
+			alloc.FreePtr(live[i].first);
+			live[i] = live.back();
+			live.pop_back();
+		}
+	}
+	const auto nanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+	alloc.IntegrityCheck();
+
+	uint64_t freeBytes = 0, largest = 0;
+	alloc.ForEachChunk([&](const auto& chunk)
+		{
+			if (chunk.used) return;
+			freeBytes += chunk.size;
+			largest = std::max<uint64_t>(largest, chunk.size);
+		});
+	const double fragmentation = freeBytes == 0 ? 0.0 : 100.0 * (1.0 - static_cast<double>(largest) / freeBytes);
+	std::cout << std::format("{:15}  {:9.1f}  {:10}  {:6.1f}  {:5}  {:14.1f}\n",
+		name, nanos / ops, alloc.freeBlocks, fragmentation, fails, distance / 1024.0 / std::max<uint64_t>(allocs, 1));
+}
+
+void BenchFreeList()
+{
+	using Lomont::Languages::FreeList;
+	std::cout << "free list        ns per op  free blocks  frag%  fails  KB between allocs\n";
+	ChurnFreeList<FreeList::AfterHead>("after head");
+	ChurnFreeList<FreeList::Lifo>("lifo");
+	ChurnFreeList<FreeList::AddressOrdered>("address ordered");
+}
+
+template<uint32_t quickBytes>
+struct QuickListPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr uint32_t quickListBytes = quickBytes;
+};
+
+// churn short lived objects of a few sizes on an Allocator, timing ops and counting merges
+template<uint32_t quickBytes>
+void ChurnQuickLists(const char* name)
+{
+	using Alloc = Lomont::Languages::BasicAllocator<QuickListPolicy<quickBytes>>;
+	constexpr uint32_t poolBytes = 1u << 20;
+	constexpr int ops = 4'000'000;
+	constexpr uint32_t sizes[] = { 12, 16, 24, 40 };
+	Alloc alloc(poolBytes);
+	std::vector<void*> live(4096, nullptr); // ring of recent objects, each freed 4096 allocations later
+	srand(2024);
+	uint32_t fails = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int op = 0; op < ops; ++op)
+	{
+		auto& slot = live[op % live.size()];
+		if (slot != nullptr)
+			alloc.FreePtr(slot);
+		slot = alloc.AllocPtr(sizes[rand() % 4]);
+		if (slot == static_cast<void*>(Alloc::InvalidAlloc))
+			++fails;
+	}
+	const auto nanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+	alloc.IntegrityCheck();
+	std::cout << std::format("{:15}  {:9.1f}  {:8}  {:5}\n", name, nanos / ops, alloc.merges, fails);
+}
+
+void BenchQuickLists()
+{
+	std::cout << "free            ns per op    merges  fails\n";
+	ChurnQuickLists<0>("coalescing");
+	ChurnQuickLists<64>("quick lists");
+}
+
+// time tearing down a request's worth of refs, one DecrRef at a time versus one Reset
+void BenchReset()
+{
+	using Lomont::Languages::GarbageCollector;
+	constexpr uint32_t poolBytes = 4u << 20;
+	std::cout << "refs      DecrRef each us  Reset us\n";
+	for (const uint32_t count : { 1'000u, 10'000u, 50'000u })
+	{
+		GarbageCollector gc(poolBytes);
+		gc.ReserveRefs(count);
+		srand(2024);
+		double decrMicros = 0, resetMicros = 0;
+		for (int teardown = 0; teardown < 2; ++teardown)
+		{
+			std::vector<GarbageCollector::Ref> refs;
+			for (auto i = 0u; i < count; ++i)
+				refs.push_back(gc.AllocRef(rand() % 48 + 8));
+			std::shuffle(refs.begin(), refs.end(), std::mt19937(count));
+			const auto start = chrono::steady_clock::now();
+			if (teardown == 0)
+				for (const auto ref : refs)
+					gc.DecrRef(ref);
+			else
+				gc.Reset();
+			const auto micros = chrono::duration<double, std::micro>(chrono::steady_clock::now() - start).count();
+			(teardown == 0 ? decrMicros : resetMicros) = micros;
+			gc.IntegrityCheck();
+		}
+		std::cout << std::format("{:6}  {:15.1f}  {:8.2f}\n", count, decrMicros, resetMicros);
+	}
+}
+
+// time a compiler pass worth of short lived nodes, as refs versus in a region
+void BenchRegions()
+{
+	using Lomont::Languages::GarbageCollector;
+	constexpr uint32_t poolBytes = 4u << 20;
+	constexpr uint32_t nodes = 10'000, passes = 50;
+	GarbageCollector gc(poolBytes);
+	gc.ReserveRefs(nodes);
+	std::vector<GarbageCollector::Ref> refs;
+	srand(2024);
+
+	auto start = chrono::steady_clock::now();
+	for (auto pass = 0u; pass < passes; ++pass)
+	{
+		for (auto i = 0u; i < nodes; ++i)
+		{
+			const auto bytes = static_cast<uint32_t>(rand() % 48 + 16);
+			refs.push_back(gc.AllocRef(bytes));
+			std::memset(gc.PointerFromRef(refs.back()), 0, bytes);
+		}
+		for (const auto ref : refs)
+			gc.DecrRef(ref);
+		refs.clear();
+	}
+	const auto refNanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+
+	start = chrono::steady_clock::now();
+	for (auto pass = 0u; pass < passes; ++pass)
+	{
+		const auto mark = gc.PushRegion(nodes * 64);
+		for (auto i = 0u; i < nodes; ++i)
+		{
+			const auto bytes = static_cast<uint32_t>(rand() % 48 + 16);
+			std::memset(gc.RegionAlloc(bytes), 0, bytes);
+		}
+		gc.PopRegion(mark);
+	}
+	const auto regionNanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+	gc.IntegrityCheck();
+
+	std::cout << "nodes via     ns per node\n";
+	std::cout << std::format("refs          {:11.1f}\n", refNanos / (nodes * passes));
+	std::cout << std::format("region        {:11.1f}\n", regionNanos / (nodes * passes));
+}
+
+// after a spike in live refs, time Compact and CompactInOrder with the table at its peak size and after CompactRefs
+void BenchShrinkRefs()
+{
+	using Lomont::Languages::GarbageCollector;
+	constexpr uint32_t poolBytes = 16u << 20, peak = 100'000;
+	GarbageCollector gc(poolBytes);
+	gc.ReserveRefs(peak);
+	std::vector<GarbageCollector::Ref> refs;
+	for (auto i = 0u; i < peak; ++i)
+		refs.push_back(gc.AllocRef(32));
+	std::vector<GarbageCollector::Ref> live;
+	for (auto i = 0u; i < peak; ++i)
+		if (i % 100 == 0)
+			live.push_back(refs[i]); // survivors spread over the whole table
+		else
+			gc.DecrRef(refs[i]);
+
+	const auto micros = [&](auto compact)
+		{
+			const auto start = chrono::steady_clock::now();
+			compact();
+			return chrono::duration<double, std::micro>(chrono::steady_clock::now() - start).count();
+		};
+	const auto report = [&](const char* name)
+		{
+			const auto compact = micros([&] { gc.Compact(); });
+			const auto inOrder = micros([&] { gc.CompactInOrder([&](auto&& place) { for (const auto ref : live) place(ref); }); });
+			std::cout << std::format("{:15}  {:7}  {:10.1f}  {:17.1f}\n", name, gc.RefTableSize(), compact, inOrder);
+		};
+	gc.Compact(); // first one moves the survivors
+	std::cout << "ref table        entries  Compact us  CompactInOrder us\n";
+	report("after spike");
+
+	// the host renumbers its handles
+	std::vector<GarbageCollector::Ref> newRef(peak, GarbageCollector::InvalidRef);
+	gc.CompactRefs([&](auto oldRef, auto ref) { newRef[oldRef] = ref; });
+	for (auto& ref : live)
+		if (newRef[ref] != GarbageCollector::InvalidRef)
+			ref = newRef[ref];
+	report("CompactRefs");
+	gc.IntegrityCheck();
+}
+
+template<template<typename> typename Table>
+struct RefTablePolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	template<typename T> using RefTable = Table<T>;
+};
+template<typename T> using VectorTable = std::vector<T>;
+template<typename T> using PagedTable = Lomont::Languages::PagedVector<T, 1024>;
+
+// AllocRef latency percentiles while the ref table grows to a million refs
+template<template<typename> typename Table>
+void GrowRefTable(const char* name)
+{
+	using GC = Lomont::Languages::BasicGarbageCollector<RefTablePolicy<Table>>;
+	constexpr uint32_t count = 1'000'000;
+	GC gc(32u << 20);
+	std::vector<double> nanos(count);
+	for (auto i = 0u; i < count; ++i)
+	{
+		const auto start = chrono::steady_clock::now();
+		const auto ref = gc.AllocRef(8);
+		nanos[i] = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+		if (ref == GC::InvalidRef)
+			throw std::runtime_error("Pool too small for bench");
+	}
+	std::sort(nanos.begin(), nanos.end());
+	const auto at = [&](double fraction) { return nanos[static_cast<size_t>(fraction * (count - 1))]; };
+	std::cout << std::format("{:8}  {:7.0f}  {:7.0f}  {:9.0f}  {:9.0f}\n", name, at(0.5), at(0.99), at(0.9999), nanos.back());
+}
+
+void BenchRefTable()
+{
+	std::cout << "table     p50 ns   p99 ns  p99.99 ns     max ns\n";
+	GrowRefTable<VectorTable>("vector");
+	GrowRefTable<PagedTable>("paged");
+}
+
+template<uint32_t sampleBytes>
+struct ProfilePolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr uint32_t profileSampleBytes = sampleBytes;
+};
+
+// AllocRef and DecrRef churn over 16 allocation sites, timed with and without sampling
+template<uint32_t sampleBytes>
+double ChurnProfiled()
+{
+	using GC = Lomont::Languages::BasicGarbageCollector<ProfilePolicy<sampleBytes>>;
+	constexpr int ops = 2'000'000;
+	GC gc(16u << 20);
+	std::vector<typename GC::Ref> live(8192, GC::InvalidRef);
+	srand(2024);
+	const auto start = chrono::steady_clock::now();
+	for (int op = 0; op < ops; ++op)
+	{
+		const auto site = static_cast<uint32_t>(rand() % 16);
+		if constexpr (sampleBytes != 0)
+			gc.SetAllocSite(site);
+		auto& slot = live[op % live.size()];
+		if (slot != GC::InvalidRef)
+			gc.DecrRef(slot);
+		slot = gc.AllocRef(16 + site * 8);
+	}
+	const auto nanos = chrono::duration<double, std::nano>(chrono::steady_clock::now() - start).count();
+	if constexpr (sampleBytes != 0)
+		WriteHeapProfile(gc, std::cout);
+	return nanos / ops;
+}
+
+void BenchProfile()
+{
+	const auto off = ChurnProfiled<0>();
+	const auto on = ChurnProfiled<64 * 1024>();
+	std::cout << std::format("profiler off {:.1f} ns per AllocRef and DecrRef, sampling 1 per 64KB {:.1f} ns\n", off, on);
+}
+
+// estimated live bytes from the profiler against the true totals, first for one small
+// allocation, which must not stand for a whole sample interval, then for a churn of many sizes
+void CheckProfiler()
+{
+	auto estimated = [](const auto& gc)
+		{
+			double bytes = 0;
+			for (const auto& site : gc.Sites())
+				bytes += site.liveBytes;
+			return bytes;
+		};
+
+	Lomont::Languages::BasicGarbageCollector<ProfilePolicy<64 * 1024>> single(1u << 20);
+	single.AllocRef(16);
+	if (estimated(single) > 64 * 1024 / 2)
+		throw runtime_error("first allocation charged a sample interval");
+
+	using GC = Lomont::Languages::BasicGarbageCollector<ProfilePolicy<4096>>;
+	GC gc(32u << 20);
+	std::vector<GC::Ref> refs;
+	srand(2024);
+	uint64_t live = 0;
+	for (auto i = 0; i < 100'000; ++i)
+	{
+		gc.SetAllocSite(i % 4);
+		refs.push_back(gc.AllocRef(16 + rand() % 16 * 16));
+		live += gc.SizeFromRef(refs.back());
+		if (i % 3 == 0)
+		{ // free a random older one
+			const auto j = rand() % refs.size();
+			live -= gc.SizeFromRef(refs[j]);
+			gc.DecrRef(refs[j]);
+			refs[j] = refs.back();
+			refs.pop_back();
+		}
+	}
+	const auto ratio = estimated(gc) / static_cast<double>(live);
+	std::cout << std::format("profiler live bytes {} estimated {:.0f} ratio {:.3f}\n", live, estimated(gc), ratio);
+	if (ratio < 0.95 || ratio > 1.05)
+		throw runtime_error("profiler estimate off");
+}
+
+// true if body throws a runtime_error, as the collector does for misuse it catches
+template<typename Body>
+bool Throws(Body&& body)
+{
+	try
+	{
+		body();
+	}
+	catch (const runtime_error&)
+	{
+		return true;
+	}
+	return false;
+}
+
+// large objects live outside the pool and never move, and freeing a ref twice is caught
+// instead of putting it on the free list twice, which would hand it out twice
+template<typename TGC>
+void CheckLargeObjects()
+{
+	TGC gc(64 * 1024);
+	gc.SetLargeObjectThreshold(4096);
+	const auto small = gc.AllocRef(100);
+	const auto large = gc.AllocRef(10'000);
+	if (gc.IsLargeRef(small) || !gc.IsLargeRef(large))
+		throw runtime_error("large object in wrong space");
+	if (gc.largeObjects != 1 || gc.largeBytes != 10'000 || gc.usedBlocks != 1)
+		throw runtime_error("large object stats wrong");
+	const auto largePtr = gc.PointerFromRef(large);
+	if (reinterpret_cast<uintptr_t>(largePtr) % Lomont::Languages::PageBytes != 0)
+		throw runtime_error("large object not page aligned");
+	std::memset(largePtr, 7, 10'000);
+	gc.DecrRef(small);
+	gc.Compact();
+	gc.IntegrityCheck();
+	if (gc.PointerFromRef(large) != largePtr || static_cast<uint8_t*>(largePtr)[9'999] != 7)
+		throw runtime_error("large object moved");
+
+	if (gc.DecrRef(large) || gc.largeObjects != 0 || gc.largeBytes != 0)
+		throw runtime_error("large object not freed");
+	gc.IntegrityCheck();
+	if (!Throws([&] { gc.DecrRef(large); }) || !Throws([&] { gc.FreeRef(small); }))
+		throw runtime_error("double free not caught");
+	if (gc.largeObjects != 0 || gc.IsLargeRef(large))
+		throw runtime_error("double free changed large objects");
+	const auto a = gc.AllocRef(16), b = gc.AllocRef(16), c = gc.AllocRef(16);
+	if (a == b || b == c || a == c)
+		throw runtime_error("ref handed out twice");
+	gc.IntegrityCheck();
+
+	gc.AllocRef(20'000);
+	gc.Reset(); // returns large objects too
+	if (gc.largeObjects != 0 || gc.largeBytes != 0 || gc.usedBlocks != 0)
+		throw runtime_error("Reset kept objects");
+	gc.IntegrityCheck();
+}
+
+// a ring of free chunks cut off from its bin passes the per chunk link checks, but the
+// incremental sweep counts free chunks per bin and catches it at the end
+void CheckDetachedBinRing()
+{
+	using Alloc = Lomont::Languages::Allocator;
+	using Size = Alloc::Size;
+	Alloc alloc(4096);
+	uint8_t* blocks[3];
+	for (auto& block : blocks)
+	{
+		block = static_cast<uint8_t*>(alloc.AllocPtr(16));
+		alloc.AllocPtr(16); // keeps the freed blocks apart
+	}
+	for (const auto block : blocks)
+		alloc.FreePtr(block);
+	for (auto sweep = 0; sweep < 2; ++sweep)
+		alloc.IntegrityCheckIncremental(1000);
+
+	// the three form one ring a, y, z; links are chunk offsets, next then prev, at the start of each block
+	auto link = [](const uint8_t* block, int which) { Size value; std::memcpy(&value, block + which * sizeof(Size), sizeof(Size)); return value; };
+	auto setLink = [](uint8_t* block, int which, Size value) { std::memcpy(block + which * sizeof(Size), &value, sizeof(Size)); };
+	const auto a = blocks[0];
+	uint8_t* y = nullptr;
+	Size aOffset = 0;
+	for (const auto other : { blocks[1], blocks[2] })
+		if (const auto offset = static_cast<Size>(link(a, 0) - (other - a)); link(other, 1) == offset)
+			y = other, aOffset = offset;
+	if (y == nullptr)
+		throw runtime_error("bin ring not as expected");
+	const auto z = y == blocks[1] ? blocks[2] : blocks[1];
+	auto offsetOf = [&](const uint8_t* block) { return static_cast<Size>(aOffset + (block - a)); };
+
+	// split into rings {a} and {y, z}, only one of which the bin head reaches
+	setLink(a, 0, aOffset);
+	setLink(a, 1, aOffset);
+	setLink(y, 1, offsetOf(z));
+	setLink(z, 0, offsetOf(y));
+	if (!Throws([&] { for (auto sweep = 0; sweep < 2; ++sweep) alloc.IntegrityCheckIncremental(1000); }))
+		throw runtime_error("detached bin ring not caught");
+}
+
+// IncrRef throws at the count limit instead of carrying into the hot and large flags
+template<typename TGC>
+void CheckRefCountLimit()
+{
+	using Lomont::Languages::Placement;
+	TGC gc(32 * 1024);
+	gc.SetLargeObjectThreshold(4096);
+	const auto refs = { gc.AllocRef(16, Placement::Cold), gc.AllocRef(10'000) };
+	const auto limit = static_cast<uint32_t>(static_cast<typename TGC::Ref>(-1) >> 2);
+	for (const auto ref : refs)
+	{
+		const auto large = gc.IsLargeRef(ref);
+		while (gc.RefCount(ref) < limit)
+			gc.IncrRef(ref);
+		if (!Throws([&] { gc.IncrRef(ref); }) || gc.RefCount(ref) != limit || gc.IsLargeRef(ref) != large)
+			throw runtime_error("reference count overflowed into flags");
+		for (auto i = 1u; i < limit; ++i)
+			gc.DecrRef(ref);
+		if (gc.RefCount(ref) != 1)
+			throw runtime_error("reference count wrong after overflow");
+		gc.DecrRef(ref);
+	}
+	if (gc.usedBlocks != 0 || gc.largeObjects != 0)
+		throw runtime_error("refs at the count limit not freed");
+	gc.IntegrityCheck();
+}
+
+// a block costs sizeof(Ref) more only with blockOwners, and either way heap maps name each block's owner
+template<typename TGC>
+void CheckBlockOwners(uint32_t tinyBlockBytes)
+{
+	TGC gc(4096);
+	const auto ref = gc.AllocRef(4);
+	if (gc.usedMem != tinyBlockBytes)
+		throw runtime_error("4 byte block has wrong size");
+	const auto raw = gc.AllocPtr(4);
+	const auto second = gc.AllocRef(40);
+	uint32_t owned = 0, unowned = 0;
+	gc.ForEachChunk([&](const auto& chunk)
+		{
+			if (!chunk.used)
+				return;
+			if (chunk.owner == ref || chunk.owner == second)
+				++owned;
+			else if (chunk.owner == TGC::InvalidOwner)
+				++unowned;
+		});
+	if (owned != 2 || unowned != 1)
+		throw runtime_error("chunk owners wrong");
+	gc.FreePtr(raw);
+	gc.Compact();
+	gc.IntegrityCheck();
+	if (gc.SizeFromRef(second) != 40)
+		throw runtime_error("ref lost in Compact");
+}
+
+// fake clock for FrameScheduler, where time passes only with work: 100ns per reading and 50ns per chunk moved
+template<typename TGC>
+struct WorkClock
+{
+	using duration = std::chrono::nanoseconds;
+	using rep = duration::rep;
+	using period = duration::period;
+	using time_point = std::chrono::time_point<WorkClock>;
+	static constexpr bool is_steady = true;
+	static inline const TGC* gc{ nullptr };
+	static inline rep readings{ 0 };
+	static time_point now() { return time_point(duration(100 * ++readings + 50 * static_cast<rep>(gc->swaps))); }
+};
+
+// churn 20 allocations a frame with 2000 live, freeing through the scheduler, return frames over maxFreeBlocks after the first 100
+template<typename TGC, typename Scheduler>
+uint32_t RunFrames(TGC& gc, Scheduler& scheduler, std::vector<std::pair<typename TGC::Ref, uint32_t>>& live, uint32_t budgetMicros)
+{
+	srand(2024);
+	uint32_t fragmentedFrames = 0;
+	for (int frame = 0; frame < 2000; ++frame)
+	{
+		for (int i = 0; i < 20; ++i)
+		{
+			const auto bytes = static_cast<uint32_t>(rand() % 240 + 16);
+			const auto ref = gc.AllocRef(bytes);
+			if (ref == TGC::InvalidRef)
+				throw runtime_error("scheduler fell behind, allocation failed");
+			std::memset(gc.PointerFromRef(ref), static_cast<uint8_t>(ref), bytes);
+			live.emplace_back(ref, bytes);
+		}
+		while (live.size() > 2000)
+		{
+			const auto j = rand() % live.size();
+			scheduler.DeferDecrRef(live[j].first);
+			live[j] = live.back();
+			live.pop_back();
+		}
+		scheduler.Tick(budgetMicros);
+		if (frame >= 100 && gc.freeBlocks > scheduler.maxFreeBlocks)
+			++fragmentedFrames;
+	}
+	return fragmentedFrames;
+}
+
+// FrameScheduler keeps each Tick within its budget, keeps fragmentation down so allocation never
+// needs a blocking Compact, and once nothing is allocated and the heap is packed, stops working.
+// Runs on WorkClock, so the result does not depend on machine speed
+template<typename TGC>
+void CheckFrameScheduler()
+{
+	constexpr uint32_t budgetMicros = 200; // about 4000 chunks of WorkClock time
+	TGC gc(1u << 20);
+	WorkClock<TGC>::gc = &gc;
+	Lomont::Languages::FrameScheduler<TGC, WorkClock<TGC>> scheduler(gc);
+	std::vector<std::pair<typename TGC::Ref, uint32_t>> live;
+	const auto fragmentedFrames = RunFrames(gc, scheduler, live, budgetMicros);
+	if (scheduler.overBudgetTicks != 0)
+		throw runtime_error("scheduler over budget");
+	if (fragmentedFrames > 100)
+		throw runtime_error("scheduler did not keep up with fragmentation");
+
+	// idle frames: pays off what is owed, then does no more steps
+	for (int frame = 0; frame < 100; ++frame)
+		scheduler.Tick(budgetMicros);
+	if (scheduler.DeferredCount() != 0 || gc.freeBlocks > scheduler.maxFreeBlocks)
+		throw runtime_error("scheduler did not settle");
+	const auto steps = scheduler.steps;
+	for (int frame = 0; frame < 100; ++frame)
+		scheduler.Tick(budgetMicros);
+	if (scheduler.steps != steps)
+		throw runtime_error("scheduler kept stepping with nothing to do");
+
+	for (const auto& [ref, bytes] : live)
+	{
+		const auto p = static_cast<const uint8_t*>(gc.PointerFromRef(ref));
+		if (gc.SizeFromRef(ref) != bytes || p[0] != static_cast<uint8_t>(ref) || p[bytes - 1] != static_cast<uint8_t>(ref))
+			throw runtime_error("memory changed");
+	}
+	gc.IntegrityCheck();
+}
+
+// the same churn on the real clock: how often Ticks overran a 1ms budget and how fragmented the heap got
+void BenchScheduler()
+{
+	using Lomont::Languages::BasicGarbageCollector;
+	using Lomont::Languages::AllocatorPolicy;
+	auto run = [](auto& gc, const char* name)
+		{
+			using TGC = std::remove_reference_t<decltype(gc)>;
+			Lomont::Languages::FrameScheduler<TGC> scheduler(gc);
+			std::vector<std::pair<typename TGC::Ref, uint32_t>> live;
+			const auto fragmentedFrames = RunFrames(gc, scheduler, live, 1000);
+			std::cout << std::format("{:13} {:5} {:11} {:6} {:10}\n", name, scheduler.ticks, scheduler.overBudgetTicks, scheduler.steps, fragmentedFrames);
+		};
+	std::cout << "policy        ticks over budget  steps fragmented\n";
+	BasicGarbageCollector<AllocatorPolicy<>> plain(1u << 20);
+	run(plain, "default");
+	BasicGarbageCollector<BlockOwnersPolicy> owners(1u << 20);
+	run(owners, "blockOwners");
+}
+
+// CompactInOrder places blocks in the given order, and a failed allocation anywhere in it leaves
+// the heap unchanged
+template<typename TGC>
+void CheckCompactInOrder()
+{
+	TGC gc(4096);
+	gc.CompactInOrder([](auto&&) {}); // nothing live
+	if (gc.freeBlocks != 1)
+		throw runtime_error("empty CompactInOrder changed the heap");
+	gc.IntegrityCheck();
+
+	std::vector<typename TGC::Ref> live;
+	for (uint32_t i = 0; i < 30; ++i)
+	{
+		const auto ref = gc.AllocRef(8 + i * 4);
+		std::memset(gc.PointerFromRef(ref), static_cast<uint8_t>(ref), gc.SizeFromRef(ref));
+		if (i % 3 == 1)
+			gc.DecrRef(ref);
+		else
+			live.push_back(ref);
+	}
+	auto check = [&]
+		{
+			gc.IntegrityCheck();
+			for (const auto ref : live)
+			{
+				const auto p = static_cast<const uint8_t*>(gc.PointerFromRef(ref));
+				if (p[0] != static_cast<uint8_t>(ref) || p[gc.SizeFromRef(ref) - 1] != static_cast<uint8_t>(ref))
+					throw runtime_error("memory changed");
+			}
+		};
+	const auto freeBlocks = gc.freeBlocks;
+	auto compact = [&] { gc.CompactInOrder([&](auto&& place) { for (auto it = live.rbegin(); it != live.rend(); ++it) place(*it); }); };
+	for (int64_t failAfter = 0;; ++failAfter)
+	{
+		allocationsBeforeFailure = failAfter;
+		try
+		{
+			compact();
+			allocationsBeforeFailure = -1;
+			break;
+		}
+		catch (const std::bad_alloc&)
+		{
+			allocationsBeforeFailure = -1;
+		}
+		if (gc.freeBlocks != freeBlocks)
+			throw runtime_error("failed CompactInOrder changed the heap");
+		check();
+	}
+	check();
+	if (gc.freeBlocks != 1)
+		throw runtime_error("CompactInOrder left free blocks");
+	for (size_t i = 1; i < live.size(); ++i)
+		if (gc.PointerFromRef(live[i]) >= gc.PointerFromRef(live[i - 1]))
+			throw runtime_error("CompactInOrder order wrong");
+}
+
+// CompactAsync rejects an empty batch, moves a full batch of chunks between suspensions, even
+// when every other chunk is free, and leaves a consistent heap at every suspension
+template<typename TGC>
+void CheckCompactAsync()
+{
+	constexpr uint32_t blocks = 500, batch = 16;
+	TGC gc(1u << 16);
+	std::vector<typename TGC::Ref> live;
+	for (uint32_t i = 0; i < blocks; ++i)
+	{
+		const auto ref = gc.AllocRef(32);
+		std::memset(gc.PointerFromRef(ref), static_cast<uint8_t>(ref), 32);
+		if (i % 2 == 0)
+			gc.DecrRef(ref);
+		else
+			live.push_back(ref);
+	}
+	if (!Throws([&] { (void)Lomont::Languages::CompactAsync(gc, [] { return std::suspend_always{}; }, 0); }))
+		throw runtime_error("CompactAsync took an empty batch");
+	auto task = Lomont::Languages::CompactAsync(gc, [] { return std::suspend_always{}; }, batch);
+	uint32_t resumes = 0;
+	while (!task.Resume())
+	{
+		++resumes;
+		gc.IntegrityCheck();
+		for (const auto ref : live)
+			if (static_cast<const uint8_t*>(gc.PointerFromRef(ref))[31] != static_cast<uint8_t>(ref))
+				throw runtime_error("memory changed");
+		gc.DecrRef(gc.AllocRef(16)); // other work between batches
+	}
+	if (resumes > live.size() / batch + 2)
+		throw runtime_error("CompactAsync suspended before its batch was done");
+	if (task.await_resume() == 0 || gc.freeBlocks != 1)
+		throw runtime_error("CompactAsync did not compact");
+	gc.IntegrityCheck();
+}
+
+// heat counts PointerFromRef calls, from any thread, scaled, halved by Compact, and hot blocks are gathered low
+void CheckHeat()
+{
+	using TGC = Lomont::Languages::BasicGarbageCollector<HeatPolicy<2>>;
+	TGC gc(4096);
+	const auto cold = gc.AllocRef(32);
+	const auto hot = gc.AllocRef(32);
+	for (int i = 0; i < 20; ++i)
+		(void)gc.PointerFromRef(hot);
+	std::thread reader([&] { for (int i = 0; i < 20; ++i) (void)gc.PointerFromRef(hot); });
+	reader.join();
+	if (gc.Heat(hot) != 20 || gc.Heat(cold) != 0)
+		throw runtime_error("heat count wrong");
+	gc.Compact();
+	gc.IntegrityCheck();
+	if (gc.Heat(hot) != 10)
+		throw runtime_error("Compact did not halve heat");
+	if (gc.PointerFromRef(hot) >= gc.PointerFromRef(cold))
+		throw runtime_error("hot block not placed below cold");
+}
+
+struct ParanoidQuickPolicy : Lomont::Languages::AllocatorPolicy<Lomont::Languages::Checks::Paranoid>
+{
+	static constexpr uint32_t quickListBytes = 48;
+};
+
+// quick lists park small frees apart from used and free memory, hand the same block back, show
+// parked chunks as free in heap walks without flushing, and merge them when the bins run dry
+template<typename TAlloc, bool paranoid = false>
+void CheckQuickLists()
+{
+	TAlloc alloc(1024);
+	const auto a = alloc.AllocPtr(16);
+	const auto b = alloc.AllocPtr(16);
+	const auto c = alloc.AllocPtr(16);
+	const auto usedMem = alloc.usedMem, freeMem = alloc.freeMem, freeBlocks = alloc.freeBlocks;
+	alloc.FreePtr(b);
+	alloc.IntegrityCheck();
+	if (alloc.quickBlocks != 1 || alloc.usedBlocks != 2 || alloc.quickMem + alloc.usedMem != usedMem ||
+		alloc.freeMem != freeMem || alloc.freeBlocks != freeBlocks)
+		throw runtime_error("quick list stats wrong");
+
+	uint32_t freeSeen = 0, usedSeen = 0;
+	alloc.ForEachChunk([&](const auto& chunk) { (chunk.used ? usedSeen : freeSeen) += 1; });
+	if (usedSeen != 2 || freeSeen != 2 || alloc.quickBlocks != 1)
+		throw runtime_error("ForEachChunk wrong or flushed quick lists");
+
+	if (alloc.AllocPtr(16) != b || alloc.quickBlocks != 0 || alloc.usedMem != usedMem)
+		throw runtime_error("parked block not reused");
+	alloc.IntegrityCheck();
+
+	alloc.FreePtr(b);
+	if constexpr (paranoid)
+		if (!Throws([&] { alloc.FreePtr(b); }))
+			throw runtime_error("double free of a parked block not caught");
+
+	// fill the pool with small blocks, the first reusing b, park them all, then a large request must flush and merge them
+	std::vector<void*> small{ a, c };
+	for (void* p; (p = alloc.AllocPtr(16)) != TAlloc::InvalidAlloc;)
+		small.push_back(p);
+	for (const auto p : small)
+		alloc.FreePtr(p);
+	alloc.IntegrityCheck();
+	if (alloc.usedBlocks != 0 || alloc.quickBlocks != small.size())
+		throw runtime_error("quick list stats wrong");
+	if (alloc.AllocPtr(512) == TAlloc::InvalidAlloc || alloc.quickBlocks != 0 || alloc.freeBlocks != 1)
+		throw runtime_error("quick lists not flushed on bin failure");
+	alloc.IntegrityCheck();
+}
+
+// DecrRefs from two other threads, racing on the same refs while the home thread drains,
+// each happen exactly once, and a heap holds at most refsPerHeap refs
+void CheckThreadHeaps()
+{
+	using Heaps = Lomont::Languages::ThreadHeaps<>;
+	constexpr uint32_t count = 1000;
+	Heaps heaps(3, 1u << 16, count);
+	std::vector<Heaps::Ref> refs;
+	std::atomic<bool> allocated{ false };
+	std::atomic<int> done{ 0 };
+	std::string error;
+	std::thread home([&]
+		{
+			heaps.AttachThread(0);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const auto ref = heaps.AllocRef(16);
+				heaps.IncrRef(ref); // one DecrRef from each other thread
+				refs.push_back(ref);
+			}
+			allocated = true;
+			uint32_t drained = 0;
+			while (done < 2)
+				drained += heaps.DrainHandoffs();
+			drained += heaps.DrainHandoffs();
+			auto& gc = heaps.HeapAt(0);
+			gc.IntegrityCheck();
+			if (drained != 2 * count || gc.usedBlocks != 0)
+				error = "handed off DecrRefs lost or repeated";
+			for (uint32_t i = 0; i < count; ++i)
+				if (heaps.AllocRef(16) == Heaps::InvalidRef)
+					error = "heap refused refs under its limit";
+			if (heaps.AllocRef(16) != Heaps::InvalidRef)
+				error = "heap went over its ref limit";
+		});
+	auto remote = [&](uint32_t index)
+		{
+			heaps.AttachThread(index);
+			while (!allocated)
+				std::this_thread::yield();
+			for (const auto ref : refs)
+				heaps.DecrRef(ref);
+			++done;
+		};
+	std::thread first(remote, 1), second(remote, 2);
+	first.join();
+	second.join();
+	home.join();
+	if (!error.empty())
+		throw runtime_error(error);
+}
+
+// WriteHeapMap writes the documented GCHM v1 bytes, and snapshots concatenate
+template<typename TGC>
+void CheckHeapMap()
+{
+	TGC gc(4096);
+	const auto a = gc.AllocRef(40);
+	const auto b = gc.AllocRef(100);
+	const auto raw = gc.AllocPtr(24);
+	gc.AllocRef(60);
+	gc.DecrRef(b);
+	std::vector<typename TGC::ChunkInfo> expected;
+	gc.ForEachChunk([&](const auto& chunk) { expected.push_back(chunk); });
+
+	std::ostringstream os(std::ios::binary);
+	Lomont::Languages::WriteHeapMap(gc, os, 0x0102030405060708ull);
+	gc.FreePtr(raw);
+	Lomont::Languages::WriteHeapMap(gc, os, 7);
+	const auto bytes = os.str();
+
+	size_t at = 0;
+	auto get = [&](int count)
+		{
+			if (at + count > bytes.size())
+				throw runtime_error("heap map truncated");
+			uint64_t value = 0;
+			for (int i = 0; i < count; ++i)
+				value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[at++])) << (8 * i);
+			return value;
+		};
+	if (bytes.compare(0, 4, "GCHM") != 0 || bytes.compare(8, 8, "\x08\x07\x06\x05\x04\x03\x02\x01", 8) != 0)
+		throw runtime_error("heap map header bytes wrong");
+	at = 4;
+	if (get(4) != 1 || get(8) != 0x0102030405060708ull || get(4) != gc.size() || get(4) != expected.size())
+		throw runtime_error("heap map header wrong");
+	for (const auto& chunk : expected)
+		if (get(4) != chunk.offset || get(4) != chunk.size || get(1) != (chunk.used ? 1u : 0u) || get(4) != chunk.owner)
+			throw runtime_error("heap map chunk wrong");
+	uint32_t owned = 0;
+	for (const auto& chunk : expected)
+		owned += chunk.owner == a ? 1 : 0;
+	if (owned != 1)
+		throw runtime_error("heap map owner wrong");
+
+	// second snapshot, one chunk fewer since the freed block merged
+	if (bytes.compare(at, 4, "GCHM") != 0)
+		throw runtime_error("second snapshot missing");
+	at += 4;
+	if (get(4) != 1 || get(8) != 7 || get(4) != gc.size())
+		throw runtime_error("second heap map header wrong");
+	const auto chunks = get(4);
+	at += chunks * 13;
+	if (at != bytes.size() || chunks + 1 != expected.size())
+		throw runtime_error("second heap map size wrong");
+}
+
+// blocks freed from other threads with RemoteFreeRef and RemoteFreePtr stay allocated until the
+// owner drains them, in one batch, explicitly or on its next AllocRef, and large refs are refused
+template<typename TGC>
+void CheckRemoteFrees()
+{
+	TGC gc(1u << 16);
+	std::vector<typename TGC::Ref> refs;
+	std::vector<void*> raws;
+	for (uint32_t i = 0; i < 200; ++i)
+	{
+		refs.push_back(gc.AllocRef(8 + i % 32));
+		std::memset(gc.PointerFromRef(refs.back()), static_cast<uint8_t>(i), gc.SizeFromRef(refs.back()));
+		if (i % 4 == 0)
+			raws.push_back(gc.AllocPtr(12));
+	}
+	const auto usedBlocks = gc.usedBlocks;
+	std::thread refFreer([&] { for (size_t i = 0; i < refs.size(); i += 2) gc.RemoteFreeRef(refs[i]); });
+	std::thread ptrFreer([&] { for (const auto p : raws) gc.RemoteFreePtr(p); });
+	refFreer.join();
+	ptrFreer.join();
+	if (gc.usedBlocks != usedBlocks)
+		throw runtime_error("remote frees applied before drain");
+	if (gc.DrainRemoteFrees() != refs.size() / 2 + raws.size() || gc.DrainRemoteFrees() != 0)
+		throw runtime_error("remote frees drained wrong count");
+	if (gc.usedBlocks != refs.size() / 2)
+		throw runtime_error("remote frees not freed");
+	gc.IntegrityCheck();
+	for (size_t i = 1; i < refs.size(); i += 2)
+		if (static_cast<const uint8_t*>(gc.PointerFromRef(refs[i]))[0] != static_cast<uint8_t>(i))
+			throw runtime_error("memory changed");
+
+	// a freed ref is reused, and AllocRef drains first
+	std::thread([&] { gc.RemoteFreeRef(refs[1]); }).join();
+	const auto ref = gc.AllocRef(8);
+	if (gc.usedBlocks != refs.size() / 2 || ref == TGC::InvalidRef)
+		throw runtime_error("AllocRef did not drain remote frees");
+	if (std::find(refs.begin(), refs.end(), ref) == refs.end())
+		throw runtime_error("freed ref not reused");
+	gc.IntegrityCheck();
+
+	// large objects have no pool block to queue through, so are refused, leaving nothing queued
+	gc.SetLargeObjectThreshold(4096);
+	const auto large = gc.AllocRef(10'000);
+	if (!Throws([&] { gc.RemoteFreeRef(large); }) || gc.DrainRemoteFrees() != 0 || !gc.IsLargeRef(large))
+		throw runtime_error("remote free of a large object not refused");
+	gc.DecrRef(large);
+	if (gc.largeObjects != 0)
+		throw runtime_error("large object not freed");
+	gc.IntegrityCheck();
+}
+
+// CopyFromRef from another thread sees whole blocks while the owner allocates, grows the ref
+// table, and compacts, and ReadValidate fails across a move
+template<typename TGC>
+void CheckLockFreeReads()
+{
+	constexpr uint32_t words = 8;
+	TGC gc(1u << 18);
+	std::vector<typename TGC::Ref> stable;
+	for (uint32_t i = 0; i < 64; ++i)
+	{
+		const auto ref = gc.AllocRef(words * sizeof(uint32_t));
+		auto p = static_cast<uint32_t*>(gc.PointerFromRef(ref));
+		std::fill(p, p + words, ref * 2654435761u);
+		stable.push_back(ref);
+	}
+
+	const auto seq = gc.ReadBegin();
+	gc.DecrRef(stable.front()); // a gap, so Compact moves the others
+	stable.erase(stable.begin());
+	gc.Compact();
+	if (gc.ReadValidate(seq) || !gc.ReadValidate(gc.ReadBegin()))
+		throw runtime_error("ReadValidate wrong");
+
+	std::atomic<bool> stop{ false };
+	std::atomic<uint64_t> reads{ 0 };
+	std::string error;
+	std::thread reader([&]
+		{
+			uint32_t copy[words];
+			for (uint32_t i = 0; !stop; ++i)
+			{
+				const auto ref = stable[i % stable.size()];
+				gc.CopyFromRef(ref, copy, 0, sizeof(copy));
+				for (const auto w : copy)
+					if (w != ref * 2654435761u)
+						error = "torn read";
+				++reads;
+			}
+		});
+	std::vector<typename TGC::Ref> churn;
+	srand(58);
+	for (int round = 0; round < 2000 || reads < 1000; ++round)
+	{
+		for (int i = 0; i < 20; ++i)
+			churn.push_back(gc.AllocRef(static_cast<uint32_t>(rand() % 64 + 4))); // grows the ref table
+		for (int i = 0; i < 15; ++i)
+		{
+			const auto j = rand() % churn.size();
+			gc.DecrRef(churn[j]);
+			churn[j] = churn.back();
+			churn.pop_back();
+		}
+		if (round % 2 == 0)
+			gc.CompactStep(8);
+		else if (round % 50 == 1)
+			gc.Compact();
+		if (churn.size() > 2000)
+		{
+			for (const auto ref : churn)
+				gc.DecrRef(ref);
+			churn.clear();
+		}
+	}
+	stop = true;
+	reader.join();
+	if (!error.empty())
+		throw runtime_error(error);
+	gc.IntegrityCheck();
+}
+
+// records events, with a low large allocation threshold
+struct RecordingTracer
+{
+	static constexpr bool enabled = true;
+	static constexpr uint32_t largeAllocBytes = 256;
+	struct Event
+	{
+		Lomont::Languages::TraceEvent event;
+		char phase;
+		uint64_t bytes;
+		bool operator==(const Event&) const = default;
+	};
+	std::vector<Event> events;
+	void Begin(Lomont::Languages::TraceEvent event) { events.push_back({ event, 'B', 0 }); }
+	void End(Lomont::Languages::TraceEvent event, uint64_t bytes) { events.push_back({ event, 'E', bytes }); }
+	void Instant(Lomont::Languages::TraceEvent event, uint64_t bytes) { events.push_back({ event, 'i', bytes }); }
+};
+
+template<bool owners>
+struct TracedPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	using Tracer = RecordingTracer;
+	static constexpr bool blockOwners = owners;
+};
+
+// the paged ref table allocates nothing until the first ref, then grows across pages and directories in place
+template<typename TGC>
+void CheckRefTable(uint32_t bytes)
+{
+	auto allocations = heapAllocations.load();
+	{ Lomont::Languages::BasicAllocator<typename TGC::PolicyType> allocator(bytes); }
+	const auto allocatorAllocations = heapAllocations.load() - allocations;
+	allocations = heapAllocations.load();
+	TGC gc(bytes);
+	if (heapAllocations.load() - allocations != allocatorAllocations)
+		throw runtime_error("new collector allocated a ref table page");
+
+	std::vector<typename TGC::Ref> refs;
+	for (auto i = 0u; i < 3000; ++i) // 3 pages of 1024, or 47 of 64, so the directory grows too
+	{
+		refs.push_back(gc.AllocRef(4));
+		std::memcpy(gc.PointerFromRef(refs.back()), &i, sizeof(i));
+	}
+	if (gc.RefTableSize() != 3000)
+		throw runtime_error("ref table size wrong");
+	for (auto i = 0u; i < refs.size(); ++i)
+	{
+		uint32_t value;
+		std::memcpy(&value, gc.PointerFromRef(refs[i]), sizeof(value));
+		if (refs[i] != i || value != i || gc.SizeFromRef(refs[i]) != 4)
+			throw runtime_error("ref table entry lost as it grew");
+	}
+	for (auto i = 1000u; i < refs.size(); ++i)
+		gc.DecrRef(refs[i]);
+	if (gc.ShrinkRefs() != 2000 || gc.RefTableSize() != 1000)
+		throw runtime_error("ShrinkRefs wrong");
+	for (auto i = 0u; i < 1000; ++i)
+	{
+		uint32_t value;
+		std::memcpy(&value, gc.PointerFromRef(refs[i]), sizeof(value));
+		if (value != i)
+			throw runtime_error("ref table entry lost by ShrinkRefs");
+	}
+	if (gc.AllocRef(4) != 1000)
+		throw runtime_error("ref table did not regrow after ShrinkRefs");
+	gc.IntegrityCheck();
+}
+
+// tracers see requested sizes, not block overhead, and each Compact phase in order
+template<typename TGC>
+void CheckTracer()
+{
+	using Lomont::Languages::TraceEvent;
+	using Event = RecordingTracer::Event;
+	TGC gc(4096);
+	auto& events = gc.tracer.events;
+
+	const auto large = gc.AllocRef(300);
+	gc.AllocRef(255); // under the threshold
+	if (events != std::vector<Event>{ { TraceEvent::LargeAlloc, 'i', 300 } })
+		throw runtime_error("large allocation not traced with its requested size");
+
+	events.clear();
+	const auto a = gc.AllocRef(40);
+	const auto b = gc.AllocRef(40);
+	gc.AllocRef(40);
+	gc.DecrRef(a);
+	gc.DecrRef(b); // merges with a's free chunk
+	if (events.size() != 1 || events[0].event != TraceEvent::Merge || events[0].phase != 'i' || events[0].bytes == 0)
+		throw runtime_error("merge not traced");
+
+	events.clear();
+	if (gc.AllocRef(5000) != TGC::InvalidRef)
+		throw runtime_error("oversize allocation succeeded");
+	if (events != std::vector<Event>{ { TraceEvent::AllocFail, 'i', 5000 } })
+		throw runtime_error("allocation failure not traced with its requested size");
+
+	events.clear();
+	const auto bytesMoved = gc.bytesMoved;
+	gc.Compact();
+	const auto slid = gc.bytesMoved - bytesMoved;
+	const TraceEvent phases[] = { TraceEvent::CompactMarkRefs, TraceEvent::CompactUnlinkFree, TraceEvent::CompactSlide,
+		TraceEvent::CompactFreeChunk, TraceEvent::CompactFixRefs };
+	if (events.size() != 12 || events.front() != Event{ TraceEvent::Compact, 'B', 0 } || events.back() != Event{ TraceEvent::Compact, 'E', slid })
+		throw runtime_error("Compact not traced");
+	for (int i = 0; i < 5; ++i)
+		if (events[1 + 2 * i].event != phases[i] || events[1 + 2 * i].phase != 'B' ||
+			events[2 + 2 * i].event != phases[i] || events[2 + 2 * i].phase != 'E')
+			throw runtime_error("Compact phases out of order");
+	if (events[6].bytes != slid || events[8].bytes != gc.freeMem)
+		throw runtime_error("Compact phase bytes wrong");
+	if (slid == 0 || gc.SizeFromRef(large) != 300)
+		throw runtime_error("Compact moved nothing");
+}
+
+// Placement::Hot allocations take the lowest fitting free chunk, and Compact gathers hot blocks
+// below cold ones, keeping address order in each group, without touching reference counts
+template<typename TGC>
+void CheckHotPlacement()
+{
+	using Lomont::Languages::Placement;
+	TGC gc(1u << 16);
+	std::vector<std::pair<typename TGC::Ref, bool>> live; // ref, hot
+	srand(65);
+	for (uint32_t i = 0; i < 200; ++i)
+	{
+		const bool hot = rand() % 3 == 0;
+		const auto ref = gc.AllocRef(static_cast<uint32_t>(rand() % 60 + 8), hot ? Placement::Hot : Placement::Cold);
+		std::memset(gc.PointerFromRef(ref), static_cast<uint8_t>(ref), gc.SizeFromRef(ref));
+		live.emplace_back(ref, hot);
+	}
+	for (size_t i = 0; i < live.size(); i += 5)
+		gc.DecrRef(live[i].first);
+	std::erase_if(live, [&](const auto& entry) { return gc.PointerFromRef(entry.first) == nullptr; });
+	const auto shared = live[0].first;
+	gc.IncrRef(shared);
+
+	// order within each group, by address before compaction
+	auto byAddress = [&](auto a, auto b) { return gc.PointerFromRef(a.first) < gc.PointerFromRef(b.first); };
+	std::sort(live.begin(), live.end(), byAddress);
+	std::stable_partition(live.begin(), live.end(), [](const auto& entry) { return entry.second; });
+	gc.Compact();
+	gc.IntegrityCheck();
+	if (!std::is_sorted(live.begin(), live.end(), byAddress))
+		throw runtime_error("Compact did not place hot blocks first in address order");
+	for (const auto& [ref, hot] : live)
+		if (static_cast<const uint8_t*>(gc.PointerFromRef(ref))[gc.SizeFromRef(ref) - 1] != static_cast<uint8_t>(ref))
+			throw runtime_error("memory changed");
+	for (const auto& [ref, hot] : live)
+		if (gc.RefCount(ref) != (ref == shared ? 2u : 1u))
+			throw runtime_error("placement leaked into the reference count");
+
+	// free chunks above and below the cold blocks just allocated, the hot request takes the lowest
+	// space, the cold one does not
+	const auto first = gc.AllocRef(64);
+	gc.AllocRef(64);
+	const auto second = gc.AllocRef(64);
+	gc.AllocRef(64);
+	const auto lowPointer = std::min(gc.PointerFromRef(first), gc.PointerFromRef(second));
+	gc.DecrRef(first);
+	gc.DecrRef(second);
+	const auto hot = gc.AllocRef(64, Placement::Hot);
+	const auto cold = gc.AllocRef(64);
+	if (gc.PointerFromRef(hot) > lowPointer || gc.PointerFromRef(cold) < gc.PointerFromRef(hot))
+		throw runtime_error("hot allocation did not take the lowest chunk");
+	gc.IntegrityCheck();
+}
+
+// regions bump allocate in one slice, nest stack fashion, and free everything on pop, and
+// Reset empties the pool, the ref table, and any open regions at once
+template<typename TGC>
+void CheckRegionsAndReset()
+{
+	TGC gc(1u << 16);
+	const auto kept = gc.AllocRef(32);
+	const auto usedBlocks = gc.usedBlocks;
+
+	const auto outer = gc.PushRegion(4096);
+	if (outer.depth != 1 || gc.usedBlocks != usedBlocks + 1)
+		throw runtime_error("region slice not reserved");
+	const auto a = static_cast<uint8_t*>(gc.RegionAlloc(10));
+	const auto b = static_cast<uint8_t*>(gc.RegionAlloc(20));
+	if (a == nullptr || b < a + 10 || b > a + 13) // rounded up to the chunk granularity
+		throw runtime_error("region allocations not bumped in order");
+	std::memset(a, 0x5A, 10);
+
+	const auto inner = gc.PushRegion();
+	const auto c = gc.RegionAlloc(100);
+	gc.PopRegion(inner);
+	if (gc.RegionAlloc(100) != c)
+		throw runtime_error("inner region not released");
+	const auto second = gc.PushRegion(), third = gc.PushRegion();
+	if (!Throws([&] { gc.PopRegion(second); }))
+		throw runtime_error("out of order pop not caught");
+	gc.PopRegion(third);
+	gc.PopRegion(second);
+	if (gc.RegionAlloc(8192) != nullptr)
+		throw runtime_error("region allocated past its slice");
+
+	const auto promoted = gc.PromoteRegionAlloc(a, 10);
+	gc.PopRegion(outer);
+	gc.IntegrityCheck();
+	if (gc.usedBlocks != usedBlocks + 1 || gc.RegionAlloc(8) != nullptr)
+		throw runtime_error("outer region not released");
+	if (static_cast<const uint8_t*>(gc.PointerFromRef(promoted))[9] != 0x5A || gc.SizeFromRef(kept) != 32)
+		throw runtime_error("promoted allocation lost");
+	if (!Throws([&] { gc.PushRegion(); }))
+		throw runtime_error("outermost region without a size allowed");
+
+	// Reset with a region open and refs live
+	gc.PushRegion(1024);
+	for (int i = 0; i < 100; ++i)
+		gc.AllocRef(40);
+	gc.Reset();
+	gc.IntegrityCheck();
+	if (gc.usedBlocks != 0 || gc.freeBlocks != 1 || gc.freeMem != gc.size() || gc.RefTableSize() != 0 || gc.RegionAlloc(8) != nullptr)
+		throw runtime_error("Reset left state behind");
+	if (gc.AllocRef(16) != 0 || gc.PushRegion(1024).depth != 1)
+		throw runtime_error("collector not usable after Reset");
+	gc.IntegrityCheck();
+
+	Lomont::Languages::BasicAllocator<typename TGC::PolicyType> alloc(4096);
+	for (int i = 0; i < 10; ++i)
+		alloc.AllocPtr(100);
+	alloc.Reset();
+	alloc.IntegrityCheck();
+	if (alloc.usedBlocks != 0 || alloc.freeBlocks != 1 || alloc.freeMem != alloc.size())
+		throw runtime_error("Allocator Reset left blocks");
+}
+
+struct TypedPolicy : Lomont::Languages::AllocatorPolicy<>
+{
+	static constexpr uint32_t maxTypes = 2;
+	static constexpr uint32_t profileSampleBytes = 4096;
+};
+
+// registered types count live objects, trace children, and finalize, which may free children,
+// and the heap profile text is in pprof's legacy format with a line per site
+void CheckTypesAndProfile()
+{
+	using TGC = Lomont::Languages::BasicGarbageCollector<TypedPolicy>;
+	using Ref = TGC::Ref;
+	static TGC* current = nullptr;
+	static uint32_t finalized = 0;
+	TGC gc(1u << 20);
+	current = &gc;
+	finalized = 0;
+
+	// a node holds two child refs, InvalidRef if none
+	const auto node = gc.RegisterType("Node",
+		[](const void* object, uint32_t, void (*visit)(void*, Ref), void* context)
+		{
+			for (const auto child : { static_cast<const Ref*>(object)[0], static_cast<const Ref*>(object)[1] })
+				if (child != TGC::InvalidRef)
+					visit(context, child);
+		},
+		[](void* object, uint32_t byteSize)
+		{
+			if (byteSize != 2 * sizeof(Ref))
+				throw runtime_error("finalizer got wrong size");
+			++finalized;
+			for (const auto child : { static_cast<const Ref*>(object)[0], static_cast<const Ref*>(object)[1] })
+				if (child != TGC::InvalidRef)
+					current->DecrRef(child);
+		});
+	const auto blob = gc.RegisterType("Blob");
+	if (node != 1 || blob != 2 || gc.TypeCount() != 2 || !Throws([&] { gc.RegisterType("Full"); }))
+		throw runtime_error("type registry ids wrong");
+	if (!Throws([&] { (void)gc.AllocRef(8, 3); }))
+		throw runtime_error("unknown type allowed");
+
+	auto makeNode = [&](Ref left, Ref right)
+		{
+			const auto ref = gc.AllocRef(2 * sizeof(Ref), node);
+			const Ref children[] = { left, right };
+			std::memcpy(gc.PointerFromRef(ref), children, sizeof(children));
+			return ref;
+		};
+	const auto leaf = gc.AllocRef(100, blob);
+	const auto root = makeNode(makeNode(leaf, TGC::InvalidRef), makeNode(TGC::InvalidRef, TGC::InvalidRef));
+	const auto untyped = gc.AllocRef(50);
+	if (gc.TypeOf(root) != node || gc.TypeOf(leaf) != blob || gc.TypeOf(untyped) != 0)
+		throw runtime_error("TypeOf wrong");
+	if (gc.TypeStats(node).liveObjects != 3 || gc.TypeStats(node).liveBytes != 3 * 2 * sizeof(Ref) ||
+		gc.TypeStats(blob).liveBytes != 100 || gc.TypeStats(0).liveObjects != 1 || std::string(gc.TypeStats(node).name) != "Node")
+		throw runtime_error("type stats wrong");
+	std::vector<Ref> children;
+	gc.TraceRef(root, [&](Ref child) { children.push_back(child); });
+	if (children.size() != 2)
+		throw runtime_error("TraceRef wrong");
+
+	gc.DecrRef(root); // finalizers free the whole tree
+	gc.IntegrityCheck();
+	if (finalized != 3 || gc.TypeStats(node).liveObjects != 0 || gc.TypeStats(blob).liveObjects != 0 || gc.usedBlocks != 1)
+		throw runtime_error("finalizers did not free the tree");
+	makeNode(gc.AllocRef(8, blob), TGC::InvalidRef);
+	gc.Reset();
+	if (finalized != 3 || gc.TypeStats(node).liveObjects != 0 || gc.TypeStats(0).liveObjects != 0)
+		throw runtime_error("Reset ran finalizers or kept type stats");
+
+	// profile: header totals, then one line per site, addressed site + 1
+	for (uint32_t i = 0; i < 20'000; ++i)
+	{
+		gc.SetAllocSite(i % 3 == 0 ? 7 : 0x20);
+		gc.AllocRef(64);
+	}
+	std::ostringstream os;
+	Lomont::Languages::WriteHeapProfile(gc, os);
+	std::istringstream lines(os.str());
+	std::string line;
+	unsigned long long headerBytes = 0, siteBytes = 0;
+	std::vector<std::string> addresses;
+	while (std::getline(lines, line))
+	{
+		unsigned long long liveObjects, liveBytes, allocObjects, allocBytes;
+		char address[32];
+		if (std::sscanf(line.c_str(), "heap profile: %llu: %llu [%llu: %llu] @ heapprofile", &liveObjects, &headerBytes, &allocObjects, &allocBytes) == 4)
+			continue;
+		if (std::sscanf(line.c_str(), "%llu: %llu [%llu: %llu] @ %31s", &liveObjects, &liveBytes, &allocObjects, &allocBytes, address) != 5 || liveBytes > allocBytes)
+			throw runtime_error("bad heap profile line " + line);
+		siteBytes += liveBytes;
+		addresses.emplace_back(address);
+	}
+	std::sort(addresses.begin(), addresses.end());
+	if (addresses != std::vector<std::string>{ "0x21", "0x8" } || headerBytes == 0 || siteBytes + 2 < headerBytes || siteBytes > headerBytes + 2)
+		throw runtime_error("heap profile wrong");
+}
+
+// focused checks of collector features, each asserting exact behavior
+void CheckFeatures()
+{
+	using Lomont::Languages::AllocatorPolicy;
+	using Lomont::Languages::BasicGarbageCollector;
+	using Lomont::Languages::Checks;
+	CheckLargeObjects<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckLargeObjects<BasicGarbageCollector<AllocatorPolicy<Checks::Paranoid>>>();
+	CheckDetachedBinRing();
+	CheckRefCountLimit<Lomont::Languages::SmallGarbageCollector>();
+	CheckBlockOwners<BasicGarbageCollector<TinyChunkPolicy>>(8);
+	CheckBlockOwners<BasicGarbageCollector<TinyOwnersPolicy>>(12);
+	CheckBlockOwners<BasicGarbageCollector<AllocatorPolicy<>>>(16);
+	CheckBlockOwners<BasicGarbageCollector<BlockOwnersPolicy>>(16);
+	CheckFrameScheduler<BasicGarbageCollector<AllocatorPolicy<>>>();
+	CheckFrameScheduler<BasicGarbageCollector<BlockOwnersPolicy>>();
+	CheckCompactInOrder<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckCompactInOrder<BasicGarbageCollector<TinyChunkPolicy>>();
+	CheckCompactAsync<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckCompactAsync<BasicGarbageCollector<BlockOwnersPolicy>>();
+	CheckHeat();
+	CheckThreadHeaps();
+	CheckStaticGC();
+	CheckHeapMap<Lomont::Languages::GarbageCollector>();
+	CheckHeapMap<Lomont::Languages::BasicGarbageCollector<BlockOwnersPolicy>>();
+	CheckRemoteFrees<BasicGarbageCollector<AllocatorPolicy<Checks::Paranoid>>>();
+	CheckRemoteFrees<BasicGarbageCollector<TinyChunkPolicy>>();
+	CheckLockFreeReads<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckLockFreeReads<BasicGarbageCollector<BlockOwnersPolicy>>();
+	CheckRefTable<Lomont::Languages::GarbageCollector>(64 * 1024);
+	CheckRefTable<Lomont::Languages::SmallGarbageCollector>(32 * 1024);
+	CheckTracer<BasicGarbageCollector<TracedPolicy<false>>>();
+	CheckTracer<BasicGarbageCollector<TracedPolicy<true>>>();
+	CheckHotPlacement<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckHotPlacement<BasicGarbageCollector<BlockOwnersPolicy>>();
+	CheckRegionsAndReset<BasicGarbageCollector<AllocatorPolicy<Checks::Light>>>();
+	CheckRegionsAndReset<BasicGarbageCollector<TinyChunkPolicy>>();
+	CheckTypesAndProfile();
+	CheckQuickLists<Lomont::Languages::BasicAllocator<QuickListPolicy<48>>>();
+	CheckQuickLists<Lomont::Languages::BasicAllocator<ParanoidQuickPolicy>, true>();
+	std::cout << "feature checks passed\n";
+}
+
+int main(int argc, char** argv)
+{
+	const std::string mode = argc > 1 ? argv[1] : "";
+	if (mode == "bench-threads")
+	{
+		BenchThreadHeaps();
+		return 0;
+	}
+	if (mode == "bench-startup")
+	{
+		BenchStartup();
+		return 0;
+	}
+	if (mode == "bench-traverse")
+	{
+		BenchTraversal();
+		return 0;
+	}
+	if (mode == "bench-heat")
+	{
+		BenchHeat();
+		return 0;
+	}
+	if (mode == "bench-freelist")
+	{
+		BenchFreeList();
+		return 0;
+	}
+	if (mode == "bench-quick")
+	{
+		BenchQuickLists();
+		return 0;
+	}
+	if (mode == "bench-reset")
+	{
+		BenchReset();
+		return 0;
+	}
+	if (mode == "bench-region")
+	{
+		BenchRegions();
+		return 0;
+	}
+	if (mode == "bench-shrink")
+	{
+		BenchShrinkRefs();
+		return 0;
+	}
+	if (mode == "bench-reftable")
+	{
+		BenchRefTable();
+		return 0;
+	}
+	if (mode == "bench-scheduler")
+	{
+		BenchScheduler();
+		return 0;
+	}
+	if (mode == "bench-profile")
+	{
+		BenchProfile();
+		return 0;
+	}
+	if (mode == "widths")
+	{
+		CompareWidths();
+		return 0;
+	}
+	if (mode == "async")
+	{
+		CheckCompactAsync<Lomont::Languages::GarbageCollector>();
+		std::cout << "async compaction passed\n";
+		return 0;
+	}
+	if (mode == "checks")
+	{
+		CheckFeatures();
+		return 0;
+	}
+	if (mode == "policies")
+	{
+		CheckPolicies();
+		CheckProfiler();
+		return 0;
+	}
+
 	CheckGC();
 
 	//CheckMem<Allocator,void*>();
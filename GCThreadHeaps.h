@@ -0,0 +1,225 @@
+/*
+MIT License
+
+Copyright (c) 2023 Chris Lomont
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ */
+
+// Chris Lomont
+// One GarbageCollector per thread, with Refs that know their home heap.
+// Kept out of GC.h so single threaded targets need no thread support.
+
+#pragma once
+
+#include "GC.h"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Lomont::Languages {
+
+	/* N independent heaps, one per worker thread, each with its own pool and ref table,
+	 * so allocation and compaction need no locks and scale with threads.
+	 *
+	 * A Ref holds its home heap index in the top heapBits bits and the heap's local ref in
+	 * the rest, so any thread can route PointerFromRef and DecrRef. A DecrRef from a thread
+	 * that is not the home thread is handed off without locks: it counts the decrement in a
+	 * per ref slot, and the first one pushes the slot onto a lock free list, see PushLockFree.
+	 * The home thread does them on its next AllocRef, Compact, or DrainHandoffs.
+	 *
+	 * Rules:
+	 * - each worker calls AttachThread once, before allocating
+	 * - AllocRef, IncrRef, Compact only on the home thread of the heap involved
+	 * - PointerFromRef and SizeFromRef from any thread, but pointers into a heap are only
+	 *   valid until that heap compacts, as with GarbageCollector
+	 * - DecrRef from any thread
+	 */
+	template<typename GC = GarbageCollector>
+	class ThreadHeaps
+	{
+	public:
+		using Ref = uint32_t;
+		using LocalRef = typename GC::Ref;
+
+		static constexpr int heapBits = 8;
+		static constexpr uint32_t MaxHeaps = 1u << heapBits;
+		static constexpr int localBits = 32 - heapBits;
+		static constexpr uint32_t localMask = (1u << localBits) - 1;
+		static constexpr Ref InvalidRef{ static_cast<Ref>(-1) };
+
+		/**
+		 * \brief Create the heaps
+		 * \param heapCount number of heaps, at most MaxHeaps, usually one per worker thread
+		 * \param bytesPerHeap size of each heap's pool
+		 * \param refsPerHeap the most live refs per heap, reserved up front, so other threads can
+		 *        read ref tables and hand off DecrRefs safely
+		 */
+		ThreadHeaps(uint32_t heapCount, uint32_t bytesPerHeap, uint32_t refsPerHeap)
+		{
+			if (heapCount == 0 || heapCount > MaxHeaps)
+				throw std::runtime_error("Bad heap count");
+			if (refsPerHeap > localMask + 1)
+				throw std::runtime_error("Too many refs per heap");
+			for (auto i = 0u; i < heapCount; ++i)
+			{
+				heaps.push_back(std::make_unique<Heap>(bytesPerHeap, refsPerHeap));
+				heaps.back()->gc.ReserveRefs(refsPerHeap);
+			}
+		}
+
+		[[nodiscard]] uint32_t HeapCount() const { return static_cast<uint32_t>(heaps.size()); }
+
+		// the collector for heap index, for stats or direct use on its home thread
+		GC& HeapAt(uint32_t index) { return heaps[index]->gc; }
+
+		/**
+		 * \brief Make the calling thread the home thread of a heap
+		 * \param heapIndex the heap this thread allocates from
+		 */
+		void AttachThread(uint32_t heapIndex)
+		{
+			heaps[heapIndex]->owner.store(std::this_thread::get_id(), std::memory_order_release);
+			current = { this, heapIndex };
+		}
+
+		/**
+		 * \brief Allocate a block on the calling thread's heap
+		 * \param requestedByteSize the size to allocate in bytes
+		 * \param placement see GarbageCollector::AllocRef
+		 * \return a ref with an initial reference count of 1, or InvalidRef
+		 */
+		Ref AllocRef(uint32_t requestedByteSize, Placement placement = Placement::Cold)
+		{
+			const auto index = HomeIndex();
+			auto& heap = *heaps[index];
+			DrainHandoffs(heap);
+			const auto local = heap.gc.AllocRef(requestedByteSize, placement);
+			if (local == GC::InvalidRef)
+				return InvalidRef;
+			if (local >= heap.refLimit)
+			{ // out of handoff slots
+				heap.gc.FreeRef(local);
+				return InvalidRef;
+			}
+			return (index << localBits) | local;
+		}
+
+		// increment a reference count, home thread only
+		void IncrRef(Ref ref) { HeapOf(ref).gc.IncrRef(Local(ref)); }
+
+		/**
+		 * \brief Decrement a reference count, from any thread. When zero, memory is released
+		 * \param ref the Ref to decrement
+		 * \return true if the reference is still alive, or if handed off to the home thread
+		 */
+		bool DecrRef(Ref ref)
+		{
+			auto& heap = HeapOf(ref);
+			const auto local = Local(ref);
+			if (heap.owner.load(std::memory_order_acquire) == std::this_thread::get_id())
+				return heap.gc.DecrRef(local);
+
+			// only the first pending decrement links the slot, later ones just count
+			auto& slot = heap.slots[local];
+			if (slot.pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+				PushLockFree(heap.handoffList, static_cast<uint32_t>(local + 1), [&slot](uint32_t next) { slot.next = next; });
+			return true;
+		}
+
+		// get size of the memory from a Ref
+		[[nodiscard]] uint32_t SizeFromRef(Ref ref) { return HeapOf(ref).gc.SizeFromRef(Local(ref)); }
+		// get the pointer to underlying memory from a Ref
+		[[nodiscard]] void* PointerFromRef(Ref ref) { return HeapOf(ref).gc.PointerFromRef(Local(ref)); }
+
+		// compact the calling thread's heap
+		void Compact()
+		{
+			auto& heap = *heaps[HomeIndex()];
+			DrainHandoffs(heap);
+			heap.gc.Compact();
+		}
+
+		// do any handed off DecrRefs for the calling thread's heap, returns number done
+		uint32_t DrainHandoffs() { return DrainHandoffs(*heaps[HomeIndex()]); }
+
+		// heap index a Ref lives in
+		static uint32_t HeapIndex(Ref ref) { return ref >> localBits; }
+
+	private:
+		// DecrRefs from other threads for one local ref
+		struct HandoffSlot
+		{
+			std::atomic<uint32_t> pending{ 0 }; // decrements not yet done
+			uint32_t next{ 0 }; // next slot's local ref plus 1 while on the handoff list
+		};
+
+		struct alignas(64) Heap
+		{
+			Heap(uint32_t bytes, uint32_t refs) : gc(bytes), slots(std::make_unique<HandoffSlot[]>(refs)), refLimit(refs) {}
+			GC gc;
+			std::atomic<std::thread::id> owner{}; // set by AttachThread, read by DecrRef on any thread
+
+			// DecrRefs from other threads, a lock free list of slots with pending decrements
+			std::unique_ptr<HandoffSlot[]> slots;
+			uint32_t refLimit;
+			std::atomic<uint32_t> handoffList{ 0 }; // head, local ref plus 1
+		};
+		std::vector<std::unique_ptr<Heap>> heaps;
+
+		// calling thread's heap
+		struct Binding
+		{
+			const ThreadHeaps* owner{ nullptr };
+			uint32_t index{ 0 };
+		};
+		static inline thread_local Binding current;
+
+		uint32_t HomeIndex() const
+		{
+			if (current.owner != this)
+				throw std::runtime_error("Thread not attached");
+			return current.index;
+		}
+
+		Heap& HeapOf(Ref ref) { return *heaps[HeapIndex(ref)]; }
+		static LocalRef Local(Ref ref) { return ref & localMask; }
+
+		uint32_t DrainHandoffs(Heap& heap)
+		{
+			if (heap.handoffList.load(std::memory_order_relaxed) == 0)
+				return 0;
+			uint32_t count = 0;
+			DrainLockFree(heap.handoffList,
+				[&heap](uint32_t link) { return heap.slots[link - 1].next; },
+				[&](uint32_t link)
+				{ // zeroing pending lets other threads link the slot again
+					const auto local = static_cast<LocalRef>(link - 1);
+					for (auto n = heap.slots[local].pending.exchange(0, std::memory_order_acq_rel); n != 0; --n, ++count)
+						heap.gc.DecrRef(local);
+				});
+			return count;
+		}
+	};
+
+}//namespace Lomont::Languages
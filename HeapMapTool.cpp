@@ -0,0 +1,176 @@
+/*
+MIT License
+
+Copyright (c) 2023 Chris Lomont
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ */
+
+// offline viewer for heap map snapshots written by WriteHeapMap in GC.h
+// renders one line per snapshot: fragmentation stats, then a strip of the heap
+//     '#' all used, '.' all free, '+' mixed
+// usage: HeapMapTool snapshots.bin [width]
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+	struct Chunk
+	{
+		uint32_t offset{ 0 }, size{ 0 };
+		bool used{ false };
+		uint32_t owner{ 0 };
+	};
+
+	struct Snapshot
+	{
+		uint64_t timestamp{ 0 };
+		uint32_t heapSize{ 0 };
+		vector<Chunk> chunks;
+	};
+
+	uint64_t Read(istream& is, int bytes)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; ++i)
+		{
+			const auto c = is.get();
+			if (c == char_traits<char>::eof())
+				throw runtime_error("truncated snapshot");
+			value |= static_cast<uint64_t>(c & 255) << (8 * i);
+		}
+		return value;
+	}
+
+	// read next snapshot, false at end of file
+	bool ReadSnapshot(istream& is, Snapshot& snapshot)
+	{
+		char magic[4];
+		if (!is.read(magic, 4))
+			return false;
+		if (string(magic, 4) != "GCHM")
+			throw runtime_error("not a heap map");
+		if (Read(is, 4) != 1)
+			throw runtime_error("unknown heap map version");
+		snapshot.timestamp = Read(is, 8);
+		snapshot.heapSize = static_cast<uint32_t>(Read(is, 4));
+		snapshot.chunks.resize(static_cast<size_t>(Read(is, 4)));
+		for (auto& c : snapshot.chunks)
+		{
+			c.offset = static_cast<uint32_t>(Read(is, 4));
+			c.size = static_cast<uint32_t>(Read(is, 4));
+			c.used = Read(is, 1) != 0;
+			c.owner = static_cast<uint32_t>(Read(is, 4));
+		}
+		return true;
+	}
+
+	// heap strip, each column covers heapSize/width bytes
+	string Render(const Snapshot& snapshot, int width)
+	{
+		vector<uint64_t> usedBytes(width, 0), totalBytes(width, 0);
+		const double bytesPerColumn = static_cast<double>(snapshot.heapSize) / width;
+		for (const auto& c : snapshot.chunks)
+		{ // spread each chunk over the columns it covers
+			uint64_t start = c.offset;
+			const uint64_t end = static_cast<uint64_t>(c.offset) + c.size;
+			while (start < end)
+			{
+				const int column = min(width - 1, static_cast<int>(start / bytesPerColumn));
+				const uint64_t columnEnd = max(start + 1, static_cast<uint64_t>((column + 1) * bytesPerColumn));
+				const uint64_t bytes = min(end, columnEnd) - start;
+				totalBytes[column] += bytes;
+				if (c.used) usedBytes[column] += bytes;
+				start += bytes;
+			}
+		}
+		string strip(width, ' ');
+		for (int i = 0; i < width; ++i)
+		{
+			if (totalBytes[i] == 0) continue;
+			strip[i] = usedBytes[i] == totalBytes[i] ? '#' : usedBytes[i] == 0 ? '.' : '+';
+		}
+		return strip;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		cerr << "usage: HeapMapTool snapshots.bin [width]\n";
+		return 1;
+	}
+	const int width = argc > 2 ? max(1, stoi(argv[2])) : 64;
+
+	ifstream file(argv[1], ios::binary);
+	if (!file)
+	{
+		cerr << "cannot open " << argv[1] << "\n";
+		return 1;
+	}
+
+	cout << "    timestamp      used      free  blocks   largest  frag%  heap\n";
+	try
+	{
+		Snapshot snapshot;
+		while (ReadSnapshot(file, snapshot))
+		{
+			uint64_t used = 0, free = 0, largest = 0, freeBlocks = 0;
+			for (const auto& c : snapshot.chunks)
+			{
+				if (c.used)
+				{
+					used += c.size;
+					continue;
+				}
+				free += c.size;
+				largest = max<uint64_t>(largest, c.size);
+				++freeBlocks;
+			}
+			// fraction of free memory not usable by one large request
+			const double fragmentation = free == 0 ? 0.0 : 100.0 * (1.0 - static_cast<double>(largest) / free);
+
+			cout << setw(13) << snapshot.timestamp
+				<< setw(10) << used
+				<< setw(10) << free
+				<< setw(8) << freeBlocks
+				<< setw(10) << largest
+				<< setw(7) << fixed << setprecision(1) << fragmentation
+				<< "  " << Render(snapshot, width) << "\n";
+		}
+	}
+	catch (const exception& e)
+	{
+		cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+// end